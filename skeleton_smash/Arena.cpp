@@ -0,0 +1,63 @@
+#include <string.h>
+#include <algorithm>
+#include "Arena.h"
+
+Arena::~Arena()
+{
+    for (Block &block : blocks)
+    {
+        delete[] block.data;
+    }
+}
+
+void *Arena::allocate(size_t size, size_t align)
+{
+    while (current < blocks.size())
+    {
+        Block &block = blocks[current];
+        size_t start = (offset + align - 1) & ~(align - 1);
+        if (start + size <= block.size)
+        {
+            offset = start + size;
+            return block.data + start;
+        }
+        current++;
+        offset = 0;
+    }
+    // only reached until the arena has grown to the largest command seen
+    size_t size_needed = std::max(block_size, size + align);
+    blocks.push_back(Block{new char[size_needed], size_needed});
+    current = blocks.size() - 1;
+    size_t start = ((size_t)blocks[current].data + align - 1) & ~(align - 1);
+    offset = start - (size_t)blocks[current].data + size;
+    return (void *)start;
+}
+
+char *Arena::copy(const std::string &s)
+{
+    char *result = allocateArray<char>(s.size() + 1);
+    memcpy(result, s.c_str(), s.size() + 1);
+    return result;
+}
+
+void Arena::reset()
+{
+    current = 0;
+    offset = 0;
+}
+
+void Arena::rewind(const Mark &m)
+{
+    current = m.current;
+    offset = m.offset;
+}
+
+size_t Arena::capacity() const
+{
+    size_t total = 0;
+    for (const Block &block : blocks)
+    {
+        total += block.size;
+    }
+    return total;
+}
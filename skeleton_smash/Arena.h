@@ -0,0 +1,83 @@
+#ifndef SMASH_ARENA_H_
+#define SMASH_ARENA_H_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#define ARENA_BLOCK_SIZE (16 * 1024)
+
+/**
+ * Monotonic allocator for everything that lives only while one command runs
+ * (the Command object, argv, the child's environment array). Nothing is freed
+ * individually; reset() rewinds the whole arena at once and keeps its blocks,
+ * so once the shell has seen its largest command no more memory is requested.
+ * A command started while another one waits takes a mark() and rewinds to it
+ * when it is done, so it gives back what it used without touching the other's.
+ */
+class Arena {
+public:
+    struct Mark {
+        size_t current;
+        size_t offset;
+    };
+private:
+    struct Block {
+        char *data;
+        size_t size;
+    };
+    std::vector<Block> blocks;
+    size_t current; // block being carved
+    size_t offset;  // first free byte in it
+    size_t block_size;
+public:
+    explicit Arena(size_t block_size = ARENA_BLOCK_SIZE) : current(0), offset(0), block_size(block_size) {}
+    Arena(Arena const &) = delete;
+    void operator=(Arena const &) = delete;
+    ~Arena();
+
+    void *allocate(size_t size, size_t align = alignof(std::max_align_t));
+
+    template <class T>
+    T *allocateArray(size_t n)
+    {
+        return static_cast<T*>(allocate(n * sizeof(T), alignof(T)));
+    }
+
+    // NUL terminated copy of s
+    char *copy(const std::string &s);
+
+    void reset();
+    Mark mark() const { return Mark{current, offset}; }
+    // frees everything allocated since m was taken
+    void rewind(const Mark &m);
+    size_t capacity() const;
+};
+
+/**
+ * std allocator adaptor, lets std::allocate_shared place the object and its
+ * control block in an Arena. deallocate is a no-op, the arena reclaims it.
+ */
+template <class T>
+class ArenaAllocator {
+private:
+    Arena *arena;
+
+    template <class U> friend class ArenaAllocator;
+public:
+    typedef T value_type;
+
+    explicit ArenaAllocator(Arena &arena) : arena(&arena) {}
+    template <class U>
+    ArenaAllocator(const ArenaAllocator<U> &other) : arena(other.arena) {}
+
+    T *allocate(size_t n) { return arena->allocateArray<T>(n); }
+    void deallocate(T *, size_t) {}
+
+    template <class U>
+    bool operator==(const ArenaAllocator<U> &other) const { return arena == other.arena; }
+    template <class U>
+    bool operator!=(const ArenaAllocator<U> &other) const { return arena != other.arena; }
+};
+
+#endif //SMASH_ARENA_H_
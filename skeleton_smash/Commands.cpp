@@ -1,14 +1,22 @@
 #include <unistd.h>
 #include <string.h>
+#include <errno.h>
+#include <sched.h>
 #include <iostream>
 #include <sstream>
 #include <sys/wait.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
 #include <fcntl.h>
 #include <iomanip>
 #include <algorithm>
 #include "Commands.h"
+#include "ParallelChmod.h"
+#include "JobPlacer.h"
+#include "Trace.h"
+#include "FanOut.h"
 #include <fstream>
 
 
@@ -48,21 +56,6 @@ string _trim(const std::string& s)
   return _rtrim(_ltrim(s));
 }
 
-int _parseCommandLine(const char* cmd_line, char** args) {
-  FUNC_ENTRY()
-  int i = 0;
-  std::istringstream iss(_trim(string(cmd_line)).c_str());
-  for(std::string s; iss >> s; ) {
-    args[i] = (char*)malloc(s.length()+1);
-    memset(args[i], 0, s.length()+1);
-    strcpy(args[i], s.c_str());
-    args[++i] = NULL;
-  }
-  return i;
-
-  FUNC_EXIT()
-}
-
 bool _isBackgroundComamnd(const char* cmd_line) {
   const string str(cmd_line);
   return str[str.find_last_not_of(WHITESPACE)] == '&';
@@ -115,9 +108,7 @@ string _getLastChar(const string input){
     return _trim(input.substr(input.find_last_not_of(" "), input.find_last_not_of(" ")));
 }
 
-bool _command_is_two_numbers(string input){
-    string first_word = _get_nth_word(input,1);
-    string second_word = _get_nth_word(input,2);
+bool _command_is_two_numbers(const string &first_word, const string &second_word){
     if (first_word.empty() || second_word.empty())
     {
         return false;
@@ -135,13 +126,103 @@ bool _command_is_two_numbers(string input){
 }
 
 
+// the $? value of a waitpid status, as sh reports it
+int _exitStatus(int status){
+    if (WIFSIGNALED(status))
+    {
+        return 128 + WTERMSIG(status);
+    }
+    return WEXITSTATUS(status);
+}
+
+// the limit that ended a job, "" unless the way it ended shows one did. only
+// the cpu limit has a signal of its own (SIGXCPU, then SIGKILL at the hard
+// limit); running out of address space, files or processes is a failing
+// syscall that the job handles as it likes, which can't be told from any
+// other failure.
+string _limitVerdict(const std::vector<ResourceLimit> &limits, int status, const struct rusage &usage)
+{
+    if (not WIFSIGNALED(status))
+    {
+        return "";
+    }
+    // the kernel checks the limit on the tick, so round the time used to the nearest second
+    rlim_t cpu_seconds = usage.ru_utime.tv_sec + usage.ru_stime.tv_sec
+                         + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec + 500000) / 1000000;
+    for (const ResourceLimit &limit : limits)
+    {
+        if (limit.resource == RLIMIT_CPU &&
+            (WTERMSIG(status) == SIGXCPU || (WTERMSIG(status) == SIGKILL && cpu_seconds >= limit.value)))
+        {
+            return "ended by limit " + limit.spec;
+        }
+    }
+    return "";
+}
+
+// how a job that did not succeed ended, "" if it did
+string _exitVerdict(int status)
+{
+    if (WIFSIGNALED(status))
+    {
+        return "killed by signal " + std::to_string(WTERMSIG(status));
+    }
+    return WEXITSTATUS(status) ? "exited with status " + std::to_string(WEXITSTATUS(status)) : "";
+}
+
+
 //---------------------------------SMASH--------------------------------//
 
-SmallShell::SmallShell() :  smash_pid(), prompt(),prev_path() {
+SmallShell::SmallShell() :  smash_pid(), prompt(), scheduler(*this), graph(*this), out_buf(STDOUT_FILENO), err_buf(STDERR_FILENO),
+                            out_stream(&out_buf), err_stream(&err_buf), running(true),
+                            interpreter(*this), last_status(0), capture_output(false),
+                            capture_size(JOB_LOG_DEFAULT_SIZE), exec_depth(0),
+                            last_background_pid(0), outer_stdout(-1) {
     setCurrentPrompt(std::string());
+    if (openDir(".", cwd)) {
+        enterDir(cwd);
+    }
+}
+
+bool SmallShell::isolateThread()
+{
+    if (unshare(CLONE_FS | CLONE_FILES) == -1) {
+        perror("smash error: unshare failed");
+        return false;
+    }
+    return true;
+}
+
+FdStreamBuf::int_type FdStreamBuf::overflow(int_type c)
+{
+    if (traits_type::eq_int_type(c, traits_type::eof())) {
+        return traits_type::not_eof(c);
+    }
+    char ch = traits_type::to_char_type(c);
+    return xsputn(&ch, 1) == 1 ? c : traits_type::eof();
+}
+
+std::streamsize FdStreamBuf::xsputn(const char *s, std::streamsize n)
+{
+    std::streamsize written = 0;
+    while (written < n) {
+        ssize_t ret = write(fd, s + written, n - written);
+        if (ret < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        written += ret;
+    }
+    return written;
 }
 
-SmallShell::~SmallShell() = default ;
+SmallShell::~SmallShell() {
+    closeDir(cwd);
+    closeDir(prev_dir);
+    for (DirHandle &dir : dir_stack) {
+        closeDir(dir);
+    }
+}
 
 
 int SmallShell::get_num_jobs() const
@@ -162,66 +243,401 @@ int SmallShell::get_num_jobs() const
 
 
 
+static const std::pair<const char*, BuiltinId> BUILTINS[] = {
+    {"chprompt", BUILTIN_CHPROMPT},
+    {"showpid", BUILTIN_SHOWPID},
+    {"pwd", BUILTIN_PWD},
+    {"cd", BUILTIN_CD},
+    {"jobs", BUILTIN_JOBS},
+    {"fg", BUILTIN_FG},
+    {"quit", BUILTIN_QUIT},
+    {"kill", BUILTIN_KILL},
+    {"chmod", BUILTIN_CHMOD},
+    {"export", BUILTIN_EXPORT},
+    {"unset", BUILTIN_UNSET},
+    {"env", BUILTIN_ENV},
+    {"pushd", BUILTIN_PUSHD},
+    {"popd", BUILTIN_POPD},
+    {"dirs", BUILTIN_DIRS},
+    {"limit", BUILTIN_LIMIT},
+    {"sched", BUILTIN_SCHED},
+    {"bgprio", BUILTIN_BGPRIO},
+    {"capture", BUILTIN_CAPTURE},
+    {"joblog", BUILTIN_JOBLOG},
+    {"every", BUILTIN_EVERY},
+    {"after", BUILTIN_AFTER},
+};
+
+BuiltinId _getBuiltinId(const string &firstWord) {
+    for (const auto &builtin : BUILTINS) {
+        if (firstWord.compare(builtin.first) == 0) {
+            return builtin.second;
+        }
+    }
+    return BUILTIN_NONE;
+}
+
+bool check_complex_command (const string cmd_line);
+
+string _resolveExecPath(const string &name, const string &path) {
+    if (name.find('/') != string::npos) {
+        return name;
+    }
+    std::istringstream dirs(path);
+    for (string dir; std::getline(dirs, dir, ':'); ) {
+        string candidate = (dir.empty() ? string(".") : dir) + "/" + name;
+        if (access(candidate.c_str(), X_OK) == 0) {
+            return candidate;
+        }
+    }
+    return string();
+}
+
+int get_redirection_type(std::string cmd_line,__SIZE_TYPE__ pos, bool pipe = false);
+
+/**
+* Parses a raw command line into the form executeCommand works on. Only called on a parse cache miss.
+*/
+static const std::pair<const char*, int> LIMITS[] = {
+    {"as", RLIMIT_AS},
+    {"cpu", RLIMIT_CPU},
+    {"nofile", RLIMIT_NOFILE},
+    {"nproc", RLIMIT_NPROC},
+};
+
+// a count with an optional K/M/G suffix, or "unlimited"
+bool _parseLimitValue(const string &text, rlim_t &value) {
+    if (text == "unlimited") {
+        value = RLIM_INFINITY;
+        return true;
+    }
+    if (text.empty() || not isdigit(text[0])) {
+        return false;
+    }
+    char *end;
+    errno = 0;
+    unsigned long long number = strtoull(text.c_str(), &end, 10);
+    unsigned int shift = 0;
+    switch (*end) {
+        case 'K': shift = 10; end++; break;
+        case 'M': shift = 20; end++; break;
+        case 'G': shift = 30; end++; break;
+    }
+    if (errno || *end || number > ((rlim_t)RLIM_INFINITY >> shift)) {
+        return false;
+    }
+    value = (rlim_t)number << shift;
+    return true;
+}
+
+// "cpu=30", one limit as written after its --
+bool _parseLimitSpec(const string &spec, ResourceLimit &limit) {
+    size_t eq = spec.find('=');
+    limit.resource = -1;
+    for (const auto &known : LIMITS) {
+        if (spec.compare(0, eq, known.first) == 0) {
+            limit.resource = known.second;
+        }
+    }
+    if (eq == string::npos || limit.resource < 0 || not _parseLimitValue(spec.substr(eq + 1), limit.value)) {
+        return false;
+    }
+    limit.spec = spec;
+    return true;
+}
+
+// moves the --name=value words after "limit" from args into limits, false if malformed
+bool _parseLimits(ParsedCommand &parsed) {
+    size_t i = 1;
+    for (; i < parsed.args.size() && parsed.args[i].compare(0, 2, "--") == 0; i++) {
+        ResourceLimit limit;
+        if (not _parseLimitSpec(parsed.args[i].substr(2), limit)) {
+            return false;
+        }
+        parsed.limits.push_back(limit);
+    }
+    if (parsed.limits.empty() || i == parsed.args.size()) {
+        return false;
+    }
+    parsed.args.erase(parsed.args.begin(), parsed.args.begin() + i);
+    return true;
+}
+
+std::shared_ptr<ParsedCommand> _parseCommand(const string &raw, const string &path) {
+    std::shared_ptr<ParsedCommand> parsed(new ParsedCommand());
+
+    // redirection / pipe detection, same rules setIO always applied to the raw line
+    bool piping = false;
+    __SIZE_TYPE__ pos = raw.find(">");
+    if (not pos) {
+        pos = raw.find("|");
+        if (pos) {
+            piping = true;
+        }
+    }
+    int redirection_type = get_redirection_type(raw, pos, piping);
+    parsed->cmd_line = raw;
+    if (redirection_type && piping) {
+        parsed->pipe_type = redirection_type;
+    }
+    else if (redirection_type) {
+        parsed->redirection_type = redirection_type;
+        parsed->redirection_path = _trim(raw.substr(pos + redirection_type));
+        parsed->cmd_line = _trim(raw.substr(0, raw.find(">")));
+    }
+
+    parsed->complex = check_complex_command(parsed->cmd_line);
+    string words = _trim(parsed->cmd_line);
+    string exec_line = parsed->cmd_line;
+    // "cmd &@3" is a background job pinned to CPU 3
+    size_t pin = words.rfind("&@");
+    if (pin != string::npos && JobPlacer::parseCpuList(words.substr(pin + 2), parsed->pinned_cpus)) {
+        words.erase(pin + 1);
+        exec_line.erase(exec_line.rfind("&@") + 1);
+    }
+    if (not words.empty() && words.back() == '&') {
+        parsed->background = true;
+        words.pop_back();
+    }
+    std::istringstream iss(words);
+    for (string word; iss >> word; ) {
+        // leading NAME=value words are environment overrides for this command only
+        if (parsed->args.empty() && isAssignment(word)) {
+            parsed->assignments.push_back(word);
+        }
+        else {
+            parsed->args.push_back(word);
+        }
+    }
+    parsed->builtin = _getBuiltinId(_get_nth_word(parsed->cmd_line, parsed->assignments.size() + 1));
+    if (parsed->builtin == BUILTIN_ENV && parsed->args.size() > 1) {
+        parsed->builtin = BUILTIN_NONE; // env with arguments is the real env(1)
+    }
+    // "limit --cpu=30 cmd" runs cmd under setrlimit, only external commands can be limited
+    if (parsed->builtin == BUILTIN_LIMIT && _parseLimits(*parsed) && _getBuiltinId(parsed->args[0]) == BUILTIN_NONE) {
+        parsed->builtin = BUILTIN_NONE;
+        string command = _removeFirstWords(exec_line, parsed->assignments.size() + 1 + parsed->limits.size());
+        exec_line.clear();
+        for (const string &assignment : parsed->assignments) {
+            exec_line += assignment + " ";
+        }
+        exec_line += command;
+    }
+    if (exec_line != parsed->cmd_line) {
+        parsed->exec_line = exec_line;
+    }
+    if (parsed->builtin == BUILTIN_NONE && not parsed->complex && not parsed->args.empty()) {
+        parsed->exec_path = _resolveExecPath(parsed->args[0], path);
+    }
+    parsed->job_name = parsed->cmd_line + " ";
+    return parsed;
+}
+
+std::shared_ptr<const ParsedCommand> SmallShell::parseCommand(const std::string &cmd_line) {
+    TraceSpan span("parse", cmd_line);
+    std::shared_ptr<const ParsedCommand> parsed = parseCache.lookup(cmd_line);
+    if (not parsed) {
+        string path;
+        environment.get("PATH", path);
+        parsed = _parseCommand(cmd_line, path);
+        parseCache.insert(cmd_line, parsed);
+    }
+    return parsed;
+}
+
+// the Command and its shared_ptr control block come from the arena, in one allocation
+template <class T>
+static std::shared_ptr<Command> _arenaCommand(Arena &arena, SmallShell &shell, std::shared_ptr<const ParsedCommand> parsed)
+{
+    return std::allocate_shared<T>(ArenaAllocator<T>(arena), shell, parsed);
+}
+
 std::shared_ptr<Command> SmallShell::CreateCommand(std::string cmd_line) {
+    return CreateCommand(parseCommand(cmd_line));
+}
 
-    string firstWord = _getFirstWord(cmd_line);
-  if (firstWord.compare("chprompt") == 0) {
-    return std::shared_ptr<Command>(new ChangePromptCommand(cmd_line));
-  }
-  else
-  if (firstWord.compare("showpid") == 0) {
-    return std::shared_ptr<Command>(new ShowPidCommand(cmd_line));
-  }
-  else if (firstWord.compare("pwd") == 0) {
-    return std::shared_ptr<Command>(new GetCurrDirCommand(cmd_line));
-  }
-  else if (firstWord.compare("cd") == 0) {
-      return std::shared_ptr<Command>(new ChangeDirCommand(cmd_line));
-  }
-  else if (firstWord.compare("jobs") == 0) {
-      return std::shared_ptr<Command>(new JobsCommand(cmd_line));
-  }
-  else if (firstWord.compare("fg") == 0) {
-      return std::shared_ptr<Command>(new ForegroundCommand(cmd_line));
-  }
-  else if (firstWord.compare("quit") == 0) {
-      return std::shared_ptr<Command>(new QuitCommand(cmd_line));
-  }
-  else if (firstWord.compare("kill") == 0) {
-      return std::shared_ptr<Command>(new KillCommand(cmd_line));
-  }
-    else if (firstWord.compare("chmod") == 0) {
-      return std::shared_ptr<Command>(new ChmodCommand(cmd_line));
-  }
-  else {
-      return std::shared_ptr<Command>(new ExternalCommand(cmd_line));
+std::shared_ptr<Command> SmallShell::CreateCommand(std::shared_ptr<const ParsedCommand> parsed) {
+  switch (parsed->builtin) {
+    case BUILTIN_CHPROMPT:
+      return _arenaCommand<ChangePromptCommand>(arena, *this, parsed);
+    case BUILTIN_SHOWPID:
+      return _arenaCommand<ShowPidCommand>(arena, *this, parsed);
+    case BUILTIN_PWD:
+      return _arenaCommand<GetCurrDirCommand>(arena, *this, parsed);
+    case BUILTIN_CD:
+      return _arenaCommand<ChangeDirCommand>(arena, *this, parsed);
+    case BUILTIN_JOBS:
+      return _arenaCommand<JobsCommand>(arena, *this, parsed);
+    case BUILTIN_FG:
+      return _arenaCommand<ForegroundCommand>(arena, *this, parsed);
+    case BUILTIN_QUIT:
+      return _arenaCommand<QuitCommand>(arena, *this, parsed);
+    case BUILTIN_KILL:
+      return _arenaCommand<KillCommand>(arena, *this, parsed);
+    case BUILTIN_CHMOD:
+      return _arenaCommand<ChmodCommand>(arena, *this, parsed);
+    case BUILTIN_EXPORT:
+      return _arenaCommand<ExportCommand>(arena, *this, parsed);
+    case BUILTIN_UNSET:
+      return _arenaCommand<UnsetCommand>(arena, *this, parsed);
+    case BUILTIN_ENV:
+      return _arenaCommand<EnvCommand>(arena, *this, parsed);
+    case BUILTIN_PUSHD:
+      return _arenaCommand<PushdCommand>(arena, *this, parsed);
+    case BUILTIN_POPD:
+      return _arenaCommand<PopdCommand>(arena, *this, parsed);
+    case BUILTIN_DIRS:
+      return _arenaCommand<DirsCommand>(arena, *this, parsed);
+    case BUILTIN_LIMIT:
+      return _arenaCommand<LimitCommand>(arena, *this, parsed);
+    case BUILTIN_SCHED:
+      return _arenaCommand<SchedCommand>(arena, *this, parsed);
+    case BUILTIN_BGPRIO:
+      return _arenaCommand<BackgroundPriorityCommand>(arena, *this, parsed);
+    case BUILTIN_CAPTURE:
+      return _arenaCommand<CaptureCommand>(arena, *this, parsed);
+    case BUILTIN_JOBLOG:
+      return _arenaCommand<JobLogCommand>(arena, *this, parsed);
+    case BUILTIN_EVERY:
+      return _arenaCommand<EveryCommand>(arena, *this, parsed);
+    case BUILTIN_AFTER:
+      return _arenaCommand<AfterCommand>(arena, *this, parsed);
+    default:
+      return _arenaCommand<ExternalCommand>(arena, *this, parsed);
   }
 }
 
-void SmallShell::executeCommand(std::string cmd_line) {
+void SmallShell::executeCommand(const std::string &cmd_line) {
+    executeCommand(cmd_line, interpreter);
+}
+
+void SmallShell::executeCommand(const std::string &cmd_line, ScriptInterpreter &source) {
+    TraceSpan span("command", cmd_line);
+    // the interpreter first: a fan-out in the body of a loop runs on every iteration, from there
+    std::shared_ptr<const ParsedCommand> parsed;
+    if (source.wants(cmd_line, parsed)) {
+        delete_finished_jobs();
+        source.feed(cmd_line);
+        return;
+    }
+    if (FanOut::matches(cmd_line)) {
+        executeFanOut(cmd_line);
+        return;
+    }
+    executeParsed(parsed ? parsed : parseCommand(cmd_line), cmd_line);
+}
+
+int SmallShell::executeFanOut(const std::string &cmd_line) {
     delete_finished_jobs();
+    std::string producer;
+    std::vector<std::string> consumers;
+    if (not FanOut::parse(cmd_line, producer, consumers)) {
+        smash_error("syntax error near unexpected token `" FANOUT_OPERATOR "'");
+        return last_status;
+    }
+    last_status = _exitStatus(FanOut(*this).run(producer, consumers));
+    return last_status;
+}
 
-    int cout_fd = setIO(cmd_line);
-    std::string cmd_line_edit = cmd_line;
-    if (cout_fd == ERROR_FD) return;
-    else if (cout_fd >= 0){
-    cmd_line_edit = _trim(cmd_line.substr(0, cmd_line.find(">")));
+// gives back the arena a command used once it is done with it. a command run while another one
+// waits (a periodic run, a job the graph starts) rewinds to where it started, the outermost one resets
+class ArenaScope {
+private:
+    Arena &arena;
+    int &depth;
+    Arena::Mark start;
+public:
+    ArenaScope(Arena &arena, int &depth) : arena(arena), depth(depth), start(arena.mark()) { depth++; }
+    ~ArenaScope() { if (--depth == 0) arena.reset(); else arena.rewind(start); }
+};
+
+int SmallShell::executeParsed(std::shared_ptr<const ParsedCommand> parsed, const std::string &cmd_line) {
+    ArenaScope scope(arena, exec_depth);
+    delete_finished_jobs();
+
+    last_status = 0;
+    if (parsed->pipe_type && setPipe(parsed->pipe_type, cmd_line) == ERROR_FD) return last_status;
+    if (parsed->args.empty()) return last_status;
+
+    int cout_fd = setIO(*parsed);
+    {
+        std::shared_ptr<Command> cmd = CreateCommand(parsed);
+        if (!cmd){throw;}
+        cmd->execute();
     }
-    std::shared_ptr<Command> cmd = CreateCommand(cmd_line_edit);
-    if (!cmd){throw;}
-    cmd->execute();
 
     defaultIO(cout_fd);
+    return last_status;
 }
 
 void SmallShell::smash_print(const string input)
 {
-    std::cout << getCurrentPrompt() << PROMPT_SUFFIX << input << endl; //TODO: endl or not to endl?
+    out() << getCurrentPrompt() << PROMPT_SUFFIX << input << endl; //TODO: endl or not to endl?
 }
 
 void SmallShell::smash_error(const string input)
 {
-    cerr << ERROR_PROMPT << input << endl;
+    err() << ERROR_PROMPT << input << endl;
+    last_status = 1;
+}
+
+int SmallShell::getStatus() const
+{
+    return last_status;
+}
+
+void SmallShell::setStatus(int status)
+{
+    last_status = status;
+}
+
+std::string SmallShell::getVariable(const std::string &name) const
+{
+    auto found = variables.find(name);
+    if (found != variables.end()) {
+        return found->second;
+    }
+    string value;
+    environment.get(name, value);
+    return value;
+}
+
+void SmallShell::setVariable(const std::string &name, const std::string &value)
+{
+    string exported;
+    if (environment.get(name, exported)) {
+        exportVariable(name, value); // already exported, keep the child environment in sync
+        return;
+    }
+    variables[name] = value;
+}
+
+void SmallShell::exportVariable(const std::string &name, const std::string &value)
+{
+    variables.erase(name);
+    environment.set(name, value);
+    if (name == "PATH") {
+        parseCache.clear(); // cached exec paths were resolved against the old PATH
+    }
+}
+
+void SmallShell::unsetVariable(const std::string &name)
+{
+    variables.erase(name);
+    environment.unset(name);
+    if (name == "PATH") {
+        parseCache.clear();
+    }
+}
+
+bool SmallShell::isShellVariable(const std::string &name) const
+{
+    return variables.count(name) != 0;
+}
+
+Environment &SmallShell::getEnvironment()
+{
+    return environment;
 }
 
 const string &SmallShell::getCurrentPrompt() const {
@@ -236,13 +652,197 @@ void SmallShell::setCurrentPrompt(const string &new_prompt)
         prompt = new_prompt;
 }
 
-string &SmallShell::getPrevPath() {
-    return prev_path;
+bool SmallShell::openDir(const std::string &path, DirHandle &dir) {
+    dir.fd = open(path.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+    dir.path.clear();
+    return dir.fd >= 0;
 }
 
-void SmallShell::addJob(std::string cmd, pid_t pid)
+bool SmallShell::enterDir(DirHandle &dir) {
+    if (fchdir(dir.fd) == -1) {
+        return false;
+    }
+    if (dir.path.empty()) { // first visit, resolve the canonical path once
+        char *path = getcwd(NULL, 0);
+        if (path == nullptr) {
+            return false;
+        }
+        dir.path = path;
+        free(path);
+    }
+    return true;
+}
+
+void SmallShell::closeDir(DirHandle &dir) {
+    if (dir.fd >= 0) {
+        close(dir.fd);
+    }
+    dir = DirHandle();
+}
+
+const std::string &SmallShell::getCurrentDir() const {
+    return cwd.path;
+}
+
+bool SmallShell::hasPrevDir() const {
+    return prev_dir.fd >= 0;
+}
+
+bool SmallShell::changeDir(const std::string &path) {
+    DirHandle target;
+    if (not openDir(path, target)) {
+        return false;
+    }
+    if (not enterDir(target)) {
+        int saved_errno = errno;
+        closeDir(target);
+        errno = saved_errno;
+        return false;
+    }
+    closeDir(prev_dir);
+    prev_dir = cwd;
+    cwd = target;
+    return true;
+}
+
+bool SmallShell::changeToPrevDir() {
+    if (not enterDir(prev_dir)) {
+        return false;
+    }
+    std::swap(cwd, prev_dir);
+    return true;
+}
+
+bool SmallShell::pushDir(const std::string &path) {
+    DirHandle target;
+    if (not openDir(path, target)) {
+        return false;
+    }
+    if (not enterDir(target)) {
+        int saved_errno = errno;
+        closeDir(target);
+        errno = saved_errno;
+        return false;
+    }
+    dir_stack.push_back(cwd);
+    cwd = target;
+    return true;
+}
+
+bool SmallShell::rotateDirs() {
+    if (not enterDir(dir_stack.back())) {
+        return false;
+    }
+    std::swap(cwd, dir_stack.back());
+    return true;
+}
+
+bool SmallShell::popDir() {
+    if (not enterDir(dir_stack.back())) {
+        return false;
+    }
+    closeDir(cwd);
+    cwd = dir_stack.back();
+    dir_stack.pop_back();
+    return true;
+}
+
+const std::vector<DirHandle> &SmallShell::getDirStack() const {
+    return dir_stack;
+}
+
+std::shared_ptr<JobsList::JobEntry> SmallShell::addJob(const std::string &cmd, pid_t pid, const std::vector<ResourceLimit> &limits,
+                                                      const std::vector<int> &cpus, bool demoted)
 {
-    jobsList.addJob(cmd, pid);
+    return jobsList.addJob(cmd, pid, limits, cpus, demoted);
+}
+
+int SmallShell::waitForJob(pid_t pid)
+{
+    int status = 0;
+    struct rusage usage;
+    std::shared_ptr<JobsList::JobEntry> job = jobsList.getJobByPid(pid);
+    if (job)
+    {
+        job->set_waited(true); // a command started meanwhile must not reap it from under us
+    }
+#ifdef SYS_pidfd_open
+    // keep draining the captured output of background jobs while this one runs
+    int pidfd = syscall(SYS_pidfd_open, pid, 0);
+    if (pidfd != -1)
+    {
+        bool exited = false;
+        events.add(pidfd, POLLIN, [&exited](int, short) { exited = true; }, true);
+        while (not exited && events.runOnce(-1, true) >= 0) {}
+        events.remove(pidfd);
+        close(pidfd);
+        Trace::instant("exit", std::to_string(pid));
+    }
+#endif
+    pid_t reaped = wait4(pid, &status, 0, &usage);
+    if (reaped != pid)
+    {
+        // not our child (adopted from an earlier smash), or reaped already: how it ended is
+        // unknown, so it counts as failed, and the job graph sees it gone once it leaves the list
+        return WAIT_STATUS_UNKNOWN;
+    }
+    if (job && not job->get_limits().empty())
+    {
+        // the job is in front of the user, who sees how it failed but not whether a limit did it
+        string verdict = _limitVerdict(job->get_limits(), status, usage);
+        if (not verdict.empty())
+        {
+            err() << "smash: " << job->get_command_name() << verdict << endl;
+        }
+    }
+    if (Trace::enabled())
+    {
+        Trace::instant("reap", std::to_string(pid) + " status " + std::to_string(_exitStatus(status)));
+        Trace::asyncEnd("job", pid);
+    }
+    if (job)
+    {
+        jobsList.exited.push_back(std::make_pair(pid, status));
+        graph.update();
+    }
+    return status;
+}
+
+bool SmallShell::isCapturing() const
+{
+    return capture_output;
+}
+
+size_t SmallShell::getCaptureSize() const
+{
+    return capture_size;
+}
+
+void SmallShell::setCapture(bool capture, size_t size)
+{
+    capture_output = capture;
+    capture_size = size;
+}
+
+std::vector<int> SmallShell::placeJob(const ParsedCommand &parsed)
+{
+    if (not parsed.pinned_cpus.empty() || not parsed.background)
+    {
+        return parsed.pinned_cpus;
+    }
+    int cpu = placer.place(placer.getPolicy() == PLACEMENT_LEAST_LOADED ? jobsList.cpuLoads()
+                                                                       : std::vector<unsigned int>());
+    return cpu < 0 ? std::vector<int>() : std::vector<int>(1, cpu);
+}
+
+JobPlacer &SmallShell::getJobPlacer()
+{
+    return placer;
+}
+
+JobPriority &SmallShell::getBackgroundPriority()
+{
+    return background_priority;
 }
 
 void SmallShell::deleteJob(pid_t pid)
@@ -250,13 +850,156 @@ void SmallShell::deleteJob(pid_t pid)
     jobsList.delete_job_by_pid(pid);
 }
 
-void SmallShell::printJobs() const{
-    jobsList.printJobsList();
+PeriodicScheduler &SmallShell::getScheduler()
+{
+    return scheduler;
+}
+
+void SmallShell::setLastBackgroundPid(pid_t pid)
+{
+    last_background_pid = pid;
+}
+
+pid_t SmallShell::startBackground(const std::string &cmd_line, int job_id, int *line_status)
+{
+    if (jobsList.isFull())
+    {
+        smash_error("jobs list is full, " + cmd_line + " not started");
+        return -1;
+    }
+    // the command that was interrupted keeps its $? and its redirection
+    int status = last_status;
+    int redirected = -1;
+    if (outer_stdout != -1)
+    {
+        redirected = dup(STDOUT_FILENO);
+        dup2(outer_stdout, STDOUT_FILENO);
+    }
+    last_background_pid = 0;
+    jobsList.reserveId(job_id);
+    executeParsed(parseCommand(cmd_line), cmd_line);
+    jobsList.reserveId(0);
+    if (line_status)
+    {
+        *line_status = last_status;
+    }
+    if (redirected != -1)
+    {
+        dup2(redirected, STDOUT_FILENO);
+        close(redirected);
+    }
+    last_status = status;
+    return last_background_pid;
+}
+
+bool SmallShell::restoreJobs(const std::string &path)
+{
+    if (not state.open(path, MAX_JOBS))
+    {
+        return false;
+    }
+    for (int id = 1; id < MAX_JOBS - 1; id++)
+    {
+        JobStateRecord record = state.get(id);
+        if (record.pid <= 0)
+        {
+            continue;
+        }
+        int pidfd = -1;
+#ifdef SYS_pidfd_open
+        // opened before the check, so it can only be the process that passed it
+        pidfd = syscall(SYS_pidfd_open, record.pid, 0);
+#endif
+        uint64_t ticks;
+        if (not JobStateTable::startTime(record.pid, ticks) || ticks != record.start_ticks)
+        {
+            if (pidfd != -1) close(pidfd);
+            state.erase(id); // ended while no smash was watching, or the pid belongs to someone else now
+            continue;
+        }
+        std::vector<int> cpus;
+        if (record.cpus[0])
+        {
+            JobPlacer::parseCpuList(record.cpus, cpus);
+        }
+        std::vector<ResourceLimit> limits;
+        std::istringstream specs(record.limits);
+        for (string spec; specs >> spec; )
+        {
+            ResourceLimit limit;
+            if (_parseLimitSpec(spec, limit))
+            {
+                limits.push_back(limit);
+            }
+        }
+        jobsList.reserveId(id);
+        std::shared_ptr<JobsList::JobEntry> job = jobsList.addJob(record.cmd, record.pid, limits, cpus, record.demoted);
+        jobsList.reserveId(0);
+        job->set_start_ticks(record.start_ticks);
+        job->set_adopted(true);
+        if (pidfd != -1)
+        {
+            // its exit is the only thing that can be learned about it, drop it from the list right away
+            std::weak_ptr<JobsList::JobEntry> watched = job;
+            job->set_exit_watched(true);
+            events.add(pidfd, POLLIN, [this, watched](int fd, short) {
+                events.remove(fd);
+                close(fd);
+                std::shared_ptr<JobsList::JobEntry> ended = watched.lock();
+                if (ended)
+                {
+                    ended->set_ended(true);
+                }
+                delete_finished_jobs();
+            }, true);
+        }
+    }
+    // from here on every add and delete is written through
+    jobsList.state = &state;
+    return true;
+}
+
+void SmallShell::detachFromParent()
+{
+    events.clear();
+    // the mapping is shared with the parent, the child's copy of the jobs list must not write to it
+    jobsList.state = nullptr;
+}
+
+JobGraph &SmallShell::getJobGraph()
+{
+    return graph;
+}
+
+bool SmallShell::cancelScheduled(int Id, int signum)
+{
+    std::shared_ptr<JobsList::JobEntry> job = jobsList.getJobById(Id);
+    if (not job || job->has_process())
+    {
+        return false;
+    }
+    jobsList.removeJobById(Id);
+    if (job->get_periodic())
+    {
+        job->get_periodic()->signalRuns(signum);
+    }
+    if (job->get_pending())
+    {
+        // jobs waiting for it find out it will not succeed
+        job->get_pending()->state = PendingJob::DROPPED;
+        graph.update();
+    }
+    return true;
+}
+
+void SmallShell::printJobs(){
+    jobsList.printJobsList(out());
+    jobsList.printReports(out());
 }
 
 void SmallShell::killall()
 {
-    jobsList.killAllJobs();
+    jobsList.killAllJobs(out(), getCurrentPrompt());
 }
 
 std::shared_ptr<JobsList::JobEntry> SmallShell::getJobById(int Id)
@@ -272,11 +1015,72 @@ pid_t SmallShell::getPidById(int Id)
     else return 0;
 }
 
+pid_t SmallShell::signalJob(int Id, int signum)
+{
+    pid_t target_pid = getPidById(Id);
+    if (target_pid != 0)
+    {
+        kill(target_pid, signum);
+    }
+    return target_pid;
+}
+
+const JobsList &SmallShell::getJobs() const
+{
+    return jobsList;
+}
+
+JobsList &SmallShell::getJobs()
+{
+    return jobsList;
+}
+
+void SmallShell::removeFinishedJobs()
+{
+    delete_finished_jobs();
+}
+
+EventLoop &SmallShell::getEventLoop()
+{
+    return events;
+}
+
+Arena &SmallShell::getArena()
+{
+    return arena;
+}
+
+const ParseCache &SmallShell::getParseCache() const
+{
+    return parseCache;
+}
+
+std::ostream &SmallShell::out()
+{
+    return out_stream;
+}
+
+std::ostream &SmallShell::err()
+{
+    return err_stream;
+}
+
+void SmallShell::quit()
+{
+    running = false;
+}
+
+bool SmallShell::isRunning() const
+{
+    return running;
+}
+
 void SmallShell::delete_finished_jobs() {
     jobsList.delete_finished_jobs();
+    graph.update();
 }
 
-int get_redirection_type(std::string cmd_line,__SIZE_TYPE__ pos, bool pipe = false)
+int get_redirection_type(std::string cmd_line,__SIZE_TYPE__ pos, bool pipe)
 {
     if (pos == std::string::npos){
         return 0;
@@ -293,28 +1097,20 @@ int get_redirection_type(std::string cmd_line,__SIZE_TYPE__ pos, bool pipe = fal
     else return OVERWRITE;
 }
 
-int SmallShell::setIO(std::string cmd_line)
+int SmallShell::setIO(const ParsedCommand &parsed)
 {
-    int piping = not PIPE;
-    __SIZE_TYPE__ pos = cmd_line.find(">");
-    if (not pos)
-    {
-        pos = cmd_line.find("|");
-        if (pos)
-        {
-            piping = PIPE;
-        }
-    }
-    int redirection_type = get_redirection_type(cmd_line, pos, piping);
+    int redirection_type = parsed.redirection_type;
     if (not redirection_type)
     {
         return -1;
     }
 
-    if (piping) return setPipe(redirection_type, cmd_line);
-
-    string output_path = _trim(cmd_line.substr(pos+redirection_type));
+    const string &output_path = parsed.redirection_path;
     int old_cout = dup(STDOUT_FILENO);
+    if (outer_stdout == -1)
+    {
+        outer_stdout = old_cout;
+    }
     int fd;
     if (redirection_type == APPEND){ //>> append
         fd = open(output_path.c_str(), O_CREAT | O_WRONLY | O_APPEND, 0755);
@@ -330,6 +1126,10 @@ int SmallShell::setIO(std::string cmd_line)
 void SmallShell::defaultIO(int old_cout){
     if(old_cout >= 0)
     {
+        if (old_cout == outer_stdout)
+        {
+            outer_stdout = -1;
+        }
         close(STDOUT_FILENO);
         dup2(old_cout, STDOUT_FILENO);
         close(old_cout);
@@ -357,48 +1157,197 @@ std::string JobsList::JobEntry::get_command_name() {
 
 std::shared_ptr<JobsList::JobEntry> JobsList::getJobById(int jobId)
 {
+    if (jobId < 0 || (size_t)jobId >= jobs.size())
+    {
+        return nullptr;
+    }
     return jobs[jobId];
 }
 
+std::shared_ptr<JobsList::JobEntry> JobsList::getJobByPid(const int &jobPid) const
+{
+    for (const std::shared_ptr<JobEntry> &job : jobs)
+    {
+        if (job && job->get_pid() == jobPid)
+        {
+            return job;
+        }
+    }
+    return nullptr;
+}
+
 void JobsList::delete_job_by_pid(pid_t pid){
     for (size_t i = 0; i < jobs.size(); i++)
     {
         if (jobs[i] && jobs[i]->get_pid() == pid)
         {
             // jobs.erase(jobs.begin() + i); //deletes the i-th element from jobs
+            if (state) state->erase(i);
+            keepLog(*jobs[i]);
             jobs[i] = nullptr;
             return;
         }
     }
 }
 
-void JobsList::delete_job_by_id(int jobId)
+void JobsList::delete_job_by_id(int jobId)
+{
+    jobs.erase(jobs.begin() + jobId);
+}
+
+// waits for each background job by its own pid rather than for any child: a
+// foreground job, or a fan-out part, is reaped by whoever is waiting for it,
+// and periodic runs may start commands while such a wait is in progress.
+void JobsList::delete_finished_jobs() {
+    int status;
+    struct rusage usage;
+    for (std::shared_ptr<JobEntry> &job : jobs)
+    {
+        if (not job || not job->has_process() || job->is_waited())
+        {
+            continue;
+        }
+        if (job->is_adopted())
+        {
+            // not our child, only its end can be seen, and its status is lost with the smash that started it.
+            // /proc is only read again when there is no pidfd to report the end (see restoreJobs)
+            uint64_t ticks;
+            bool ended = job->is_exit_watched() ? job->has_ended()
+                       : not JobStateTable::startTime(job->get_pid(), ticks) || ticks != job->get_start_ticks();
+            if (ended)
+            {
+                if (state) state->erase(job->get_id());
+                job = nullptr;
+            }
+            continue;
+        }
+        pid_t child_pid = wait4(job->get_pid(), &status, WNOHANG, &usage);
+        if (child_pid == 0)
+        {
+            continue; // still running
+        }
+        if (child_pid > 0)
+        {
+            if (Trace::enabled())
+            {
+                Trace::instant("reap", std::to_string(child_pid) + " status " + std::to_string(_exitStatus(status)));
+                Trace::asyncEnd("job", child_pid);
+            }
+            if (not job->get_limits().empty())
+            {
+                string verdict = _limitVerdict(job->get_limits(), status, usage);
+                if (verdict.empty())
+                {
+                    verdict = _exitVerdict(status);
+                }
+                if (not verdict.empty())
+                {
+                    reports.push_back("[" + std::to_string(job->get_id()) + "] " + job->get_command_name() + verdict);
+                }
+            }
+            exited.push_back(std::make_pair(child_pid, status));
+            if (state) state->erase(job->get_id());
+            keepLog(*job);
+        }
+        // reaped now, or there is nothing left to wait for. the record is only dropped for a job
+        // we saw end, a child of someone else (a fan-out part looking at the parent's jobs) can't tell
+        job = nullptr;
+    }
+}
+
+JobsList::JobsList() : jobs(MAX_JOBS, nullptr), reserved_id(0), state(nullptr) {}
+
+std::shared_ptr<JobsList::JobEntry> JobsList::addJob(const std::string &cmd, pid_t pid, const std::vector<ResourceLimit> &limits,
+                                                    const std::vector<int> &cpus, bool demoted) {
+    if (cmd.empty()){throw(std::exception());} //TODO: exception syntax
+    int new_id = get_new_id();
+    takeFinishedLog(new_id); // the id is taken over, and joblog %N with it
+    jobs[new_id] = std::make_shared<JobEntry>(new_id, pid, cmd, limits, cpus, demoted);
+    if (state && pid > 0)
+    {
+        uint64_t ticks = 0;
+        JobStateTable::startTime(pid, ticks);
+        jobs[new_id]->set_start_ticks(ticks);
+        string specs;
+        for (const ResourceLimit &limit : limits)
+        {
+            specs += (specs.empty() ? "" : " ") + limit.spec;
+        }
+        state->store(new_id, pid, ticks, demoted, JobPlacer::formatCpuList(cpus), specs, cmd);
+    }
+    return jobs[new_id];
+}
+
+std::vector<unsigned int> JobsList::cpuLoads() const
+{
+    std::vector<unsigned int> loads(CPU_SETSIZE, 0);
+    for (const std::shared_ptr<JobEntry> &job : jobs)
+    {
+        if (job)
+        {
+            for (int cpu : job->get_cpus())
+            {
+                loads[cpu]++;
+            }
+        }
+    }
+    return loads;
+}
+
+bool JobsList::isFull() const
+{
+    return std::find(jobs.begin() + 1, jobs.end() - 1, nullptr) == jobs.end() - 1;
+}
+
+void JobsList::reserveId(int jobId)
+{
+    reserved_id = jobId;
+}
+
+void JobsList::removeJobById(int jobId)
+{
+    if (jobId > 0 && (size_t)jobId < jobs.size())
+    {
+        if (state) state->erase(jobId);
+        jobs[jobId] = nullptr;
+    }
+}
+
+// joblog can still show what a job wrote after it was reaped, which for a short job is usually the point.
+// only the last JOB_LOG_FINISHED_KEEP are kept, each down to what its job wrote, older ones are released
+void JobsList::keepLog(const JobEntry &job)
+{
+    std::shared_ptr<JobLog> log = job.get_log();
+    if (not log)
+    {
+        return;
+    }
+    log->shrink();
+    finished_logs.push_back(std::make_pair(job.get_id(), log));
+    if (finished_logs.size() > JOB_LOG_FINISHED_KEEP)
+    {
+        finished_logs.pop_front();
+    }
+}
+
+std::shared_ptr<JobLog> JobsList::takeFinishedLog(int jobId)
 {
-    jobs.erase(jobs.begin() + jobId);
-}
-
-void JobsList::delete_finished_jobs() {
-    pid_t child_pid;
-    int status;
-    do
+    for (auto found = finished_logs.begin(); found != finished_logs.end(); ++found)
     {
-        child_pid = waitpid(-1, &status, WNOHANG);
-        if (child_pid > 0)
+        if (found->first == jobId)
         {
-            delete_job_by_pid(child_pid);
+            std::shared_ptr<JobLog> log = found->second;
+            finished_logs.erase(found);
+            return log;
         }
-    } while (child_pid > 0); //while we deleted a child, so maybe there are more left.
-}
-
-JobsList::JobsList() : jobs(MAX_JOBS, nullptr) {}
-
-void JobsList::addJob(std::string cmd, pid_t pid) {
-    if (cmd.empty()){throw(std::exception());} //TODO: exception syntax
-    int new_id = get_new_id();
-    jobs[new_id] = (std::shared_ptr<JobEntry>(new JobEntry(new_id, pid, cmd)));
+    }
+    return nullptr;
 }
 
 int JobsList::get_new_id() {
+    if (reserved_id > 0 && reserved_id < MAX_JOBS-1 && jobs[reserved_id] == nullptr) {
+        return reserved_id;
+    }
     for (int i = 1; i < MAX_JOBS-1; ++i) {
         if (jobs[i] == nullptr){
             return i;
@@ -407,59 +1356,103 @@ int JobsList::get_new_id() {
     throw;
 }
 
-void JobsList::printJobsList() const{
+void JobsList::printJobsList(std::ostream &out) const{
     for (unsigned int i=0; i<jobs.size(); i++){
         if (jobs[i])
         {
-            std::cout << "[" << jobs[i]->get_id() << "] " << jobs[i]->get_command_name() << endl;
+            out << "[" << jobs[i]->get_id() << "] " << jobs[i]->get_command_name();
+            const std::vector<int> &cpus = jobs[i]->get_cpus();
+            if (not cpus.empty())
+            {
+                out << "on cpu" << (cpus.size() > 1 ? "s " : " ") << JobPlacer::formatCpuList(cpus);
+            }
+            std::shared_ptr<PeriodicTask> task = jobs[i]->get_periodic();
+            if (task)
+            {
+                out << "ran " << task->getRuns() << " times";
+                if (task->getSkipped())
+                {
+                    out << ", skipped " << task->getSkipped();
+                }
+            }
+            if (jobs[i]->get_pending())
+            {
+                out << "waiting for" << jobs[i]->get_pending()->waitingFor();
+            }
+            out << endl;
         }
     }
 }
 
-void JobsList::killAllJobs()
+void JobsList::printReports(std::ostream &out)
+{
+    for (const string &report : reports)
+    {
+        out << report << endl;
+    }
+    reports.clear();
+}
+
+void JobsList::killAllJobs(std::ostream &out, const std::string &prompt)
 {
     int jobs_num = 0;
     string to_print = "";
     for (size_t i = 0; i < jobs.size(); i++)
     {
-        if (jobs[i])
+        if (jobs[i] && not jobs[i]->has_process())
+        {
+            jobs[i] = nullptr; // periodic or pending, no process of its own. runs are killed as jobs
+        }
+        else if (jobs[i])
         {
             jobs_num++;
             to_print += (std::to_string(jobs[i]->get_pid())) + string(": ") + jobs[i]->get_command_name() + string("\n");
             kill(jobs[i]->get_pid(),SIGKILL);
         }
     }
-    std::cout << SmallShell::getInstance().getCurrentPrompt() << ": sending SIGKILL signal to " << jobs_num << " jobs:" << endl;
-    std::cout << to_print;
+    out << prompt << ": sending SIGKILL signal to " << jobs_num << " jobs:" << endl;
+    out << to_print;
 }
 
 //---------------------------------COMMANDS---------------------------------//
 
 bool Command::run_in_foreground()
 {
-    return (_getLastChar(get_cmd_line()) != (string("&")));
+    return not parsed->background;
+}
+
+const std::string &Command::get_name() const
+{
+    return parsed->job_name;
 }
 
-std::string Command::get_name() const
+const std::string &Command::get_arg(size_t n) const
 {
-    return cmd_line;
+    static const string missing;
+    return n < parsed->args.size() ? parsed->args[n] : missing;
 }
 
 //--------------------------------BUILT-IN COMMANDS-----------------------//
 
 void BuiltInCommand::smash_print(const string input)
 {
-    SmallShell::getInstance().smash_print(input);
+    shell.smash_print(input);
 }
 
 void BuiltInCommand::smash_error(const string input)
 {
-    SmallShell::getInstance().smash_error(input);
+    shell.smash_error(input);
+}
+
+void BuiltInCommand::smash_perror(const string syscall)
+{
+    perror((ERROR_PROMPT + syscall + " failed").c_str());
+    shell.setStatus(1);
 }
 
 void ChangePromptCommand::execute() {
     //sets the second word in the input as the prompt. the first word is the command "chprompt" itself.
-    SmallShell::getInstance().setCurrentPrompt(_get_nth_word(get_cmd_line(),2));
+    shell.setCurrentPrompt(get_arg(1));
 }
 
 /**
@@ -470,60 +1463,330 @@ void ShowPidCommand::execute() {
 }
 
 void GetCurrDirCommand::execute() {
-    char* cwd = getcwd(NULL, 0); // Dynamically allocate buffer
-    if (cwd != nullptr) {
-        std::cout << cwd << std::endl; // Print the current working directory
-        free(cwd); // Free the allocated buffer
-    } else {
-        perror("getcwd() error");
-    }
+    shell.out() << shell.getCurrentDir() << std::endl; // cached when the shell entered it
 }
 
 void ChangeDirCommand::execute() {
-    char *prm[COMMAND_ARGS_MAX_LENGTH];
-    int number_of_words = _parseCommandLine(get_cmd_line().c_str(), prm);
+    int number_of_words = get_args().size();
     if (number_of_words > 2) { // too many arguments
-        cerr << "smash error: cd: too many arguments" << endl;
+        smash_error("cd: too many arguments");
+        return;
+    }
+    if (get_arg(1) == "-") { // if wants cd prev pwd
+        if (not shell.hasPrevDir()) {// no prev path
+            smash_error("cd: OLDPWD not set");
+            return;
+        }
+        if (not shell.changeToPrevDir()) {
+            smash_perror("chdir");
+        }
+    } else {
+        if (not shell.changeDir(get_arg(1))) {
+            smash_perror("chdir");
+        }
+    }
+}
+
+void PushdCommand::execute() {
+    if (get_args().size() > 2) {
+        smash_error("pushd: too many arguments");
+        return;
+    }
+    if (get_arg(1).empty()) { // swap the two top directories
+        if (shell.getDirStack().empty()) {
+            smash_error("pushd: no other directory");
+            return;
+        }
+        if (not shell.rotateDirs()) {
+            smash_perror("chdir");
+        }
+        return;
+    }
+    if (not shell.pushDir(get_arg(1))) {
+        smash_perror("chdir");
+    }
+}
+
+void PopdCommand::execute() {
+    if (get_args().size() > 1) {
+        smash_error("popd: too many arguments");
+        return;
+    }
+    if (shell.getDirStack().empty()) {
+        smash_error("popd: directory stack empty");
+        return;
+    }
+    if (not shell.popDir()) {
+        smash_perror("chdir");
+    }
+}
+
+void DirsCommand::execute() {
+    // current directory first, then the stack from its top, like bash
+    shell.out() << shell.getCurrentDir();
+    const std::vector<DirHandle> &stack = shell.getDirStack();
+    for (auto dir = stack.rbegin(); dir != stack.rend(); ++dir) {
+        shell.out() << " " << dir->path;
+    }
+    shell.out() << std::endl;
+}
+
+void LimitCommand::execute() {
+    smash_error("limit: invalid arguments");
+}
+
+void SchedCommand::execute() {
+    JobPlacer &placer = shell.getJobPlacer();
+    if (get_args().size() == 1) {
+        shell.out() << "policy: " << JobPlacer::policyName(placer.getPolicy()) << endl;
+        shell.out() << "cpus: " << JobPlacer::formatCpuList(placer.getPool()) << endl;
+        return;
+    }
+    // sched [off|rr|least-loaded] [--cpus=LIST], nothing changes unless all of it is valid
+    PlacementPolicy policy = placer.getPolicy();
+    std::vector<int> pool = placer.getPool();
+    bool have_policy = false;
+    bool have_cpus = false;
+    for (size_t i = 1; i < get_args().size(); i++) {
+        const string &arg = get_args()[i];
+        if (arg.compare(0, 7, "--cpus=") == 0 && not have_cpus) {
+            if (not JobPlacer::parseCpuList(arg.substr(7), pool)) {
+                smash_error("sched: invalid arguments");
+                return;
+            }
+            have_cpus = true;
+        }
+        else if (not have_policy && JobPlacer::parsePolicy(arg, policy)) {
+            have_policy = true;
+        }
+        else {
+            smash_error("sched: invalid arguments");
+            return;
+        }
+    }
+    if (have_cpus && not placer.setPool(pool)) {
+        smash_error("sched: cpus not available to smash");
+        return;
+    }
+    placer.setPolicy(policy);
+}
+
+void BackgroundPriorityCommand::execute() {
+    JobPriority &priority = shell.getBackgroundPriority();
+    if (get_args().size() == 1) {
+        if (priority.isEnabled()) {
+            shell.out() << "nice: +" << priority.getNice();
+            if (not priority.appliesNice()) {
+                shell.out() << " (not applied, fg could not undo it without CAP_SYS_NICE)";
+            }
+            shell.out() << endl;
+            shell.out() << "io: " << priority.ioClassName() << endl;
+        }
+        else {
+            shell.out() << "off" << endl;
+        }
+        return;
+    }
+    // bgprio off | on | [--nice=N] [--io=CLASS], any option turns the policy on
+    if (get_args().size() == 2 && (get_arg(1) == "off" || get_arg(1) == "on")) {
+        priority.setEnabled(get_arg(1) == "on");
         return;
     }
-    if (strcmp(prm[1], "-") == 0) { // if wants cd prev pwd
-        if (SmallShell::getInstance().getPrevPath().empty()) {// no prev path
-            cerr << "smash error: cd: OLDPWD not set" << endl;
+    int nice = priority.getNice();
+    int io_class = -1;
+    int io_level = 0;
+    for (size_t i = 1; i < get_args().size(); i++) {
+        const string &arg = get_args()[i];
+        if (arg.compare(0, 7, "--nice=") == 0 && arg.size() > 7 && arg.size() < 10 &&
+            arg.find_first_not_of("0123456789", 7) == string::npos) {
+            nice = stoi(arg.substr(7));
+        }
+        else if (arg.compare(0, 5, "--io=") != 0 || not JobPriority::parseIoClass(arg.substr(5), io_class, io_level)) {
+            smash_error("bgprio: invalid arguments");
             return;
         }
-        char buff[COMMAND_ARGS_MAX_LENGTH];
-        if (getcwd(buff, COMMAND_ARGS_MAX_LENGTH) == nullptr) {
-            cerr << "smash error: getcwd failed" << endl;
+    }
+    if (nice < 0 || nice > 19) {
+        smash_error("bgprio: invalid arguments");
+        return;
+    }
+    priority.setNice(nice);
+    if (io_class != -1) {
+        priority.setIoClass(io_class, io_level);
+    }
+    priority.setEnabled(true);
+}
+
+void CaptureCommand::execute() {
+    if (get_args().size() == 1) {
+        if (shell.isCapturing()) {
+            shell.out() << "on, " << shell.getCaptureSize() << " bytes per job" << endl;
+        }
+        else {
+            shell.out() << "off" << endl;
+        }
+        return;
+    }
+    // capture on | off | [on] --size=N[K|M|G]
+    bool capture = true;
+    size_t size = shell.getCaptureSize();
+    for (size_t i = 1; i < get_args().size(); i++) {
+        const string &arg = get_args()[i];
+        rlim_t value;
+        if ((arg == "on" || arg == "off") && i == 1) {
+            capture = (arg == "on");
+        }
+        else if (arg.compare(0, 7, "--size=") == 0 && _parseLimitValue(arg.substr(7), value) &&
+                 value > 0 && value != RLIM_INFINITY && value <= (1UL << 30)) {
+            size = value;
+        }
+        else {
+            smash_error("capture: invalid arguments");
             return;
         }
-        if (chdir(SmallShell::getInstance().getPrevPath().c_str()) == -1) {
-            perror("smash error: chdir failed");
+    }
+    shell.setCapture(capture, size);
+}
+
+void JobLogCommand::execute() {
+    // joblog %N [-f]
+    string id = get_arg(1);
+    if (not id.empty() && id[0] == '%') {
+        id.erase(0, 1);
+    }
+    bool follow = get_arg(2) == "-f";
+    if (id.empty() || id.size() > 9 || id.find_first_not_of("0123456789") != string::npos ||
+        get_args().size() > (follow ? 3 : 2)) {
+        smash_error("joblog: invalid arguments");
+        return;
+    }
+    int job_id = stoi(id);
+    std::shared_ptr<JobsList::JobEntry> job = shell.getJobById(job_id);
+    // a job that ended is gone from the list, its output is released once it was shown here
+    std::shared_ptr<JobLog> log = job ? job->get_log() : shell.getJobs().takeFinishedLog(job_id);
+    if (job == nullptr && log == nullptr) {
+        smash_error("job-id " + std::to_string(job_id) + " does not exist");
+        return;
+    }
+    if (log == nullptr) {
+        smash_error("joblog: output of job " + std::to_string(job_id) + " is not captured");
+        return;
+    }
+    string text;
+    log->read(0, text);
+    shell.out() << text;
+    // -f: keep printing until every writer of the job closed its output
+    for (unsigned long long printed = log->getWritten(); follow && log->isOpen(); printed = log->getWritten()) {
+        if (shell.getEventLoop().runOnce(-1, true) < 0) {
+            break;
+        }
+        text.clear();
+        log->read(printed, text);
+        shell.out() << text;
+    }
+}
+
+// the command after the first words of the line (its builtin and options), as a background
+// command line of its own that keeps the line's pin and redirection
+static string _backgroundLine(const ParsedCommand &parsed, size_t words) {
+    string line = _removeFirstWords(parsed.cmd_line, parsed.assignments.size() + words);
+    if (not parsed.pinned_cpus.empty()) {
+        line.erase(line.rfind("&@"));
+    }
+    else if (parsed.background) {
+        line.erase(line.rfind('&'));
+    }
+    line = _trim(line) + " &";
+    if (not parsed.pinned_cpus.empty()) {
+        line += "@" + JobPlacer::formatCpuList(parsed.pinned_cpus);
+    }
+    if (parsed.redirection_type) {
+        line += (parsed.redirection_type == APPEND ? " >> " : " > ") + parsed.redirection_path;
+    }
+    return line;
+}
+
+void EveryCommand::execute() {
+    // every INTERVAL [--overlap=skip|queue|kill] [--jitter=DURATION] cmd
+    uint64_t interval = 0;
+    uint64_t jitter = 0;
+    OverlapPolicy overlap = OVERLAP_SKIP;
+    size_t i = 2;
+    for (; i < get_args().size() && get_args()[i].compare(0, 2, "--") == 0; i++) {
+        const string &arg = get_args()[i];
+        if (arg.compare(0, 10, "--overlap=") == 0 && PeriodicScheduler::parseOverlap(arg.substr(10), overlap)) {
+            continue;
+        }
+        if (arg.compare(0, 9, "--jitter=") != 0 || not PeriodicScheduler::parseDuration(arg.substr(9), jitter)) {
+            smash_error("every: invalid arguments");
             return;
         }
-        SmallShell::getInstance().getPrevPath() = buff;
-    } else {
-        char buff[COMMAND_ARGS_MAX_LENGTH];
-        if (getcwd(buff, COMMAND_ARGS_MAX_LENGTH) == nullptr) {
-            cerr << "smash error: getcwd failed" << endl;
+    }
+    if (not PeriodicScheduler::parseDuration(get_arg(1), interval) || interval == 0 || i == get_args().size()) {
+        smash_error("every: invalid arguments");
+        return;
+    }
+    if (shell.getJobs().isFull()) {
+        smash_error("every: jobs list is full");
+        return;
+    }
+    std::shared_ptr<PeriodicTask> task = shell.getScheduler().add(_backgroundLine(get_parsed(), i), interval, jitter, overlap);
+    if (task) {
+        shell.addJob(get_name(), 0)->set_periodic(task);
+    }
+}
+
+void AfterCommand::execute() {
+    // after %N... [--any] -- cmd
+    std::shared_ptr<PendingJob> pending = std::make_shared<PendingJob>(string(), false);
+    size_t i = 1;
+    for (; i < get_args().size() && get_args()[i] != "--"; i++) {
+        string id = get_args()[i];
+        if (id == "--any") {
+            pending->any = true;
+            continue;
+        }
+        if (not id.empty() && id[0] == '%') {
+            id.erase(0, 1);
+        }
+        if (id.empty() || id.size() > 9 || id.find_first_not_of("0123456789") != string::npos) {
+            smash_error("after: invalid arguments");
+            return;
+        }
+        int job_id = stoi(id);
+        std::shared_ptr<JobsList::JobEntry> job = shell.getJobById(job_id);
+        if (job == nullptr) {
+            smash_error("after: job-id " + std::to_string(job_id) + " does not exist");
             return;
         }
-        if (chdir(prm[1]) == -1) {
-            perror("smash error: chdir failed");
+        if (job->get_periodic()) {
+            smash_error("after: job-id " + std::to_string(job_id) + " is periodic");
             return;
         }
-        SmallShell::getInstance().getPrevPath() = buff;
+        pending->dependencies.push_back(PendingJob::Dependency{job_id, job->get_pid(), job->get_pending(), false, false});
+    }
+    if (pending->dependencies.empty() || i + 1 >= get_args().size()) {
+        smash_error("after: invalid arguments");
+        return;
+    }
+    if (shell.getJobs().isFull()) {
+        smash_error("after: jobs list is full");
+        return;
     }
+    pending->line = _backgroundLine(get_parsed(), i + 1);
+    shell.addJob(get_name(), 0)->set_pending(pending);
+    shell.getJobGraph().add(pending);
 }
 
 void JobsCommand::execute() {
-    SmallShell::getInstance().printJobs();
+    shell.printJobs();
 }
 
 void ForegroundCommand::execute()
 {
-    if (_get_nth_word(get_cmd_line(),2).empty()) //no second argument
+    if (get_arg(1).empty()) //no second argument
     {
-        if (SmallShell::getInstance().get_num_jobs() == 0)
+        if (shell.get_num_jobs() == 0)
         {
             smash_error("fg: jobs list is empty");
         }
@@ -533,7 +1796,7 @@ void ForegroundCommand::execute()
         }
         return;
     }
-    if (not _get_nth_word(get_cmd_line(), 3).empty()) // string has more than 2 words
+    if (not get_arg(2).empty()) // string has more than 2 words
     {
         smash_error("fg: invalid arguments");
         return;
@@ -543,61 +1806,95 @@ void ForegroundCommand::execute()
     int job_id;
     try
     {
-        job_id = stoi(_get_nth_word(get_cmd_line(),2));
+        job_id = stoi(get_arg(1));
     }
     catch(const std::invalid_argument&)
     {
         smash_error("fg: invalid arguments");
         return;
     }
-    std::shared_ptr<JobsList::JobEntry> job = SmallShell::getInstance().getJobById(job_id);
+    std::shared_ptr<JobsList::JobEntry> job = shell.getJobById(job_id);
     if (job == nullptr)
     {
         smash_error("job-id " + std::to_string(job_id) + " does not exist");
     }
+    else if (job->get_periodic())
+    {
+        smash_error("fg: job-id " + std::to_string(job_id) + " is periodic");
+    }
+    else if (job->get_pending())
+    {
+        smash_error("fg: job-id " + std::to_string(job_id) + " is pending");
+    }
     else
     {
-        std::cout << job->get_command_name() << job->get_pid() << endl;
-        waitpid(job->get_pid(),nullptr,0);
-        SmallShell::getInstance().deleteJob(job->get_pid());
+        shell.out() << job->get_command_name() << job->get_pid() << endl;
+        if (job->is_demoted())
+        {
+            if (shell.getBackgroundPriority().promote(job->get_pid()))
+            {
+                job->set_demoted(false);
+            }
+            else
+            {
+                // it runs on at background priority
+                smash_perror("setpriority");
+            }
+        }
+        shell.setStatus(_exitStatus(shell.waitForJob(job->get_pid())));
+        shell.deleteJob(job->get_pid());
     }
 }
 
 void QuitCommand::execute()
 {
-    bool kill = ((_get_nth_word(get_cmd_line(),2)) == string("kill"));
-    if (kill && _get_nth_word(get_cmd_line(),3).empty()) // the string is empty except first 2 words
+    bool kill = (get_arg(1) == string("kill"));
+    if (kill && get_arg(2).empty()) // the string is empty except first 2 words
     {
-        SmallShell::getInstance().killall();
+        shell.killall();
     }
-    exit(0); //return 0
+    shell.quit();
 }
 
 void KillCommand::execute()
 {
-    const string cmd = _getTheRest(get_cmd_line()); //the commmand except the word kill.
-    if (not _command_is_two_numbers(cmd))
+    if (not _command_is_two_numbers(get_arg(1), get_arg(2)))
     {
         smash_error("kill: invalid arguments");
         return;
     }
-    int signum = -stoi(_getFirstWord(cmd));
+    int signum = -stoi(get_arg(1));
     if (signum < MIN_SIGNUM || signum > MAX_SIGNUM) //TODO: is max signum correct?
     {
         smash_error("kill: invalid arguments");
         return;
     }
 
-    int jobId = stoi(_getTheRest(cmd));
-    pid_t target_pid = SmallShell::getInstance().getPidById(jobId);
+    int jobId = stoi(get_arg(2));
+    std::shared_ptr<JobsList::JobEntry> job = shell.getJobById(jobId);
+    if (job && not job->has_process())
+    {
+        const char *kind = job->get_periodic() ? "periodic" : "pending";
+        if (signum == 0)
+        {
+            // only asks whether the job is there, as kill -0 does for a pid
+            shell.out() << kind << " job " << jobId << " exists" << endl;
+            return;
+        }
+        if (shell.cancelScheduled(jobId, signum))
+        {
+            shell.out() << kind << " job " << jobId << " cancelled" << endl;
+            return;
+        }
+    }
+    pid_t target_pid = shell.signalJob(jobId, signum);
     if (target_pid == 0)
     {
         smash_error("kill: job-id " + std::to_string(jobId) + " does not exist");
         return;
     }
-    kill(target_pid, signum);
-    // SmallShell::getInstance().deleteJob(jobId);
-    std::cout << "signal number " << signum << " was sent to pid " << target_pid << endl;
+    // shell.deleteJob(jobId);
+    shell.out() << "signal number " << signum << " was sent to pid " << target_pid << endl;
 }
 
 //--------------------------------EXTERNAL COMMANDS------------------------//
@@ -620,8 +1917,9 @@ int SmallShell::setPipe(int redirection_type,  std::string cmd_line)
             close(my_pipe[1]); //close write
             dup2(my_pipe[0],STDIN_FILENO); //set stdin to be pipe read
             close(my_pipe[0]);
-            std::shared_ptr<Command> in_command = SmallShell::getInstance().CreateCommand(_trim(cmd_line.substr(pos + redirection_type)));
+            std::shared_ptr<Command> in_command = CreateCommand(_trim(cmd_line.substr(pos + redirection_type)));
             in_command->execute();
+            waitpid(new_pid, nullptr, 0);
             close(STDIN_FILENO);
             dup2(old_cout, STDIN_FILENO);
             close(old_cout);
@@ -630,10 +1928,11 @@ int SmallShell::setPipe(int redirection_type,  std::string cmd_line)
         else
         {
             setpgrp();
+            detachFromParent();
             close(my_pipe[0]); //close read
             dup2(my_pipe[1], redirection_type); //set stdout/err to be pipe write
             close(my_pipe[1]);
-            std::shared_ptr<Command> in_command = SmallShell::getInstance().CreateCommand(_trim(cmd_line.substr(0,pos)));
+            std::shared_ptr<Command> in_command = CreateCommand(_trim(cmd_line.substr(0,pos)));
             in_command->execute();
             exit(0);
         }
@@ -648,60 +1947,220 @@ bool check_complex_command (const string cmd_line) {
     return false;
 }
 
+// the paths execvpe would try for file, searching the PATH of the given environment rather than
+// the one of this process, led by the one found when the line was parsed unless the line sets
+// a PATH of its own. NULL terminated
+char **_execCandidates(const ParsedCommand &parsed, const char *file, char **envp, Arena &arena)
+{
+    bool own_path = std::any_of(parsed.assignments.begin(), parsed.assignments.end(),
+                                [](const string &assignment) { return assignment.compare(0, 5, "PATH=") == 0; });
+    if (not parsed.exec_path.empty() && not own_path)
+    {
+        // resolved against the shell's PATH at parse time, the cache is dropped whenever PATH changes
+        char **candidates = arena.allocateArray<char*>(2);
+        candidates[0] = const_cast<char*>(parsed.exec_path.c_str());
+        candidates[1] = NULL;
+        return candidates;
+    }
+    const char *path = "";
+    for (char **entry = envp; *entry; entry++)
+    {
+        if (strncmp(*entry, "PATH=", 5) == 0)
+        {
+            path = *entry + 5;
+        }
+    }
+    bool search = strchr(file, '/') == nullptr;
+    char **candidates = arena.allocateArray<char*>(2 + (search ? std::count(path, path + strlen(path), ':') + 1 : 0));
+    char **next = candidates;
+    if (not search)
+    {
+        *next++ = const_cast<char*>(file);
+    }
+    size_t file_length = strlen(file);
+    for (const char *dir = path; search; dir = strchr(dir, ':') + 1)
+    {
+        // dir/file, an empty entry is the current directory
+        size_t length = strcspn(dir, ":");
+        const char *prefix = length ? dir : ".";
+        size_t prefix_length = length ? length : 1;
+        char *candidate = arena.allocateArray<char>(prefix_length + 1 + file_length + 1);
+        memcpy(candidate, prefix, prefix_length);
+        candidate[prefix_length] = '/';
+        memcpy(candidate + prefix_length + 1, file, file_length + 1);
+        *next++ = candidate;
+        search = dir[length] == ':';
+    }
+    *next = NULL;
+    return candidates;
+}
+
+// the child of fork only makes async-signal-safe calls until exec: with threads in the process
+// (ParallelChmod, shells embedded through libsmash) a lock malloc or stdio needs may never be released
+static void _childError(const char *syscall, bool with_reason = true)
+{
+    int error = errno;
+    const char prefix[] = "smash error: ";
+    write(STDERR_FILENO, prefix, sizeof(prefix) - 1);
+    write(STDERR_FILENO, syscall, strlen(syscall));
+    write(STDERR_FILENO, " failed", 7);
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 32)
+    // unlike strerror, this one never translates, so it does not touch the locale
+    const char *reason = with_reason ? strerrordesc_np(error) : nullptr;
+    if (reason)
+    {
+        write(STDERR_FILENO, ": ", 2);
+        write(STDERR_FILENO, reason, strlen(reason));
+    }
+#endif
+    write(STDERR_FILENO, "\n", 1);
+}
+
 void ExternalCommand::execute()
 {
-    SmallShell &smash = SmallShell::getInstance();
+    // checked here, in the child a bad pin would only fail after the job was already listed as started
+    const std::vector<int> &pinned = get_parsed().pinned_cpus;
+    if (not pinned.empty() && not shell.getJobPlacer().allows(pinned))
+    {
+        shell.smash_error("&@" + JobPlacer::formatCpuList(pinned) + ": cpus not available to jobs");
+        return;
+    }
+    // everything the child needs is laid out before fork, in the shell's arena
+    Arena &arena = shell.getArena();
+    char **envp = shell.getEnvironment().getEnvp();
+    if (not get_parsed().assignments.empty())
+    {
+        envp = shell.getEnvironment().overlay(get_parsed().assignments, arena);
+    }
+    bool demote = not run_in_foreground() && shell.getBackgroundPriority().isEnabled();
+    int capture[2] = {-1, -1};
+    if (not run_in_foreground() && shell.isCapturing() && pipe2(capture, O_CLOEXEC) == -1)
+    {
+        perror("smash error: pipe failed");
+    }
+    std::vector<int> cpus = shell.placeJob(get_parsed());
+    cpu_set_t affinity;
+    CPU_ZERO(&affinity);
+    for (int cpu : cpus)
+    {
+        CPU_SET(cpu, &affinity);
+    }
+    char **argv;
+    if (get_parsed().complex)
+    {
+        char *line = arena.copy(get_parsed().exec_line.empty() ? get_cmd_line() : get_parsed().exec_line);
+        _removeBackgroundSign(line);
+        argv = arena.allocateArray<char*>(4);
+        argv[0] = arena.copy(SMASH_BASH_PATH);
+        argv[1] = arena.copy(SMASH_C_ARG);
+        argv[2] = line;
+        argv[3] = NULL;
+    }
+    else
+    {
+        // the words are not modified by exec, point straight into the parsed command
+        argv = arena.allocateArray<char*>(get_args().size() + 1);
+        for (size_t i = 0; i < get_args().size(); i++)
+        {
+            argv[i] = const_cast<char*>(get_args()[i].c_str());
+        }
+        argv[get_args().size()] = NULL;
+    }
+    char **candidates = get_parsed().complex ? nullptr : _execCandidates(get_parsed(), argv[0], envp, arena);
     pid_t new_pid = fork();
     if (new_pid < 0){
         perror("smash error: fork failed");
+        if (capture[0] != -1)
+        {
+            close(capture[0]);
+            close(capture[1]);
+        }
         return;
     }
     else if (new_pid > 0){ // parent
+        // the child does the same, whichever runs first the group exists before fg or kill can target it
+        setpgid(new_pid, new_pid);
+        // from here, so an fg that follows right away always comes after it. a job that keeps
+        // its normal priority is still a working job
+        if (demote && not shell.getBackgroundPriority().demote(new_pid))
+        {
+            perror("smash error: setpriority failed");
+        }
+        if (Trace::enabled())
+        {
+            Trace::instant("fork", std::to_string(new_pid));
+            Trace::asyncBegin("job", new_pid, get_cmd_line());
+        }
+        if (not run_in_foreground())
+        {
+            shell.setLastBackgroundPid(new_pid);
+        }
+        std::shared_ptr<JobLog> log;
+        if (capture[0] != -1)
+        {
+            close(capture[1]);
+            log = std::make_shared<JobLog>(shell.getEventLoop(), capture[0], shell.getCaptureSize());
+        }
         if(not get_cmd_line().empty()){
-            smash.addJob(get_name(), new_pid);
+            std::shared_ptr<JobsList::JobEntry> job = shell.addJob(get_name(), new_pid, get_parsed().limits, cpus, demote);
+            job->set_log(log);
             if (run_in_foreground())
             {
-                waitpid(new_pid, NULL, 0);
-                smash.deleteJob(new_pid);
+                shell.setStatus(_exitStatus(shell.waitForJob(new_pid)));
+                shell.deleteJob(new_pid);
             }
         }
     }
     else{ // child's code:
         setpgrp();
-        char cmd_args[COMMAND_MAX_ARGS+1];
-        strcpy(cmd_args, this->get_cmd_line().c_str());
-        if (check_complex_command(get_cmd_line())){
-            char bash_path[COMMAND_ARGS_MAX_LENGTH+1];
-            strcpy(bash_path, SMASH_BASH_PATH);
-            char c_arg[COMMAND_ARGS_MAX_LENGTH+1];
-            strcpy(c_arg, SMASH_C_ARG);
-            char *args[] = {bash_path, c_arg, cmd_args, NULL};
-            if (execvp(SMASH_BASH_PATH, args) == -1)
+        if (capture[1] != -1)
+        {
+            // an explicit redirection of stdout still wins
+            if (get_parsed().redirection_type == 0)
             {
-                cerr << "smash error: execvp failed" << endl;
-                return;
+                dup2(capture[1], STDOUT_FILENO);
             }
+            dup2(capture[1], STDERR_FILENO);
         }
-        else{
-            std::string args_str = this->get_cmd_line();
-            if (not run_in_foreground())
+        if (not cpus.empty() && sched_setaffinity(0, sizeof(affinity), &affinity) == -1)
+        {
+            _childError("sched_setaffinity");
+            _exit(1);
+        }
+        for (const ResourceLimit &limit : get_parsed().limits)
+        {
+            // the hard cpu limit is a second later, so the job first gets SIGXCPU and jobs can tell why it died
+            struct rlimit value = {limit.value, limit.value};
+            if (limit.value == RLIM_INFINITY)
             {
-                args_str = _trim(args_str).substr(0, args_str.size() - 2);
+                // unlimited means as high as we are allowed, raising the hard limit needs privileges
+                getrlimit(limit.resource, &value);
+                value.rlim_cur = value.rlim_max;
             }
-            
-            char* args[COMMAND_ARGS_MAX_LENGTH+1];
-            size_t i = 1;
-            for (;not _get_nth_word(args_str,i).empty(); i++)
+            else if (limit.resource == RLIMIT_CPU)
             {
-                args[i-1] = strdup(_get_nth_word(args_str,i).c_str());
-                args[i] = NULL;
+                value.rlim_max = limit.value + 1;
             }
-            if (execvp(args[0], args) == -1)
+            if (setrlimit(limit.resource, &value) == -1)
             {
-                cerr << "smash error: execvp failed" << endl;
-                return;
+                _childError("setrlimit");
+                _exit(1);
+            }
+        }
+        // lands in the shared trace buffer, the child's own copy of everything else is lost with exec
+        Trace::instant("exec", get_cmd_line());
+        if (get_parsed().complex){
+            execve(SMASH_BASH_PATH, argv, envp);
+        }
+        else{
+            // PATH was searched once when the line was parsed, the rest of it is there in case that went stale
+            for (char **candidate = candidates; *candidate; candidate++)
+            {
+                execve(*candidate, argv, envp);
             }
         }
+        _childError("execvp", false);
+        _exit(1);
     }
 }
 
@@ -721,7 +2180,12 @@ bool isValidOctal(const std::string& str) {
 
 void ChmodCommand::execute()
 {
-    if (not _removeFirstWords(get_cmd_line(),3).empty())
+    if (get_arg(1) == "-R")
+    {
+        executeRecursive();
+        return;
+    }
+    if (get_args().size() > 3)
     {
         smash_error("chmod: invalid aruments");
         return;
@@ -729,7 +2193,7 @@ void ChmodCommand::execute()
 
     // Extract new mode from command line arguments
     int new_mode;
-    string second_word = _get_nth_word(get_cmd_line(),2);
+    string second_word = get_arg(1);
     if (! isValidOctal(second_word))
     {
         smash_error("chmod: invalid aruments");
@@ -750,13 +2214,83 @@ void ChmodCommand::execute()
         smash_error("chmod: invalid aruments");
         return;
     }
-    const char* path = _get_nth_word(get_cmd_line(),3).c_str();
+    const string path = get_arg(2);
 
     // Change file mode
-    cout << "new mode: " << new_mode << " path: " << path << endl;
-    if (chmod(path, new_mode) == 0) {
-        std::cout << "File mode changed successfully." << std::endl;
+    shell.out() << "new mode: " << new_mode << " path: " << path << endl;
+    if (chmod(path.c_str(), new_mode) == 0) {
+        shell.out() << "File mode changed successfully." << std::endl;
     } else {
-        std::cerr << "Failed to change file mode." << std::endl;
+        shell.err() << "Failed to change file mode." << std::endl;
+    }
+}
+
+void ChmodCommand::executeRecursive()
+{
+    // chmod -R MODE dir...
+    if (get_args().size() < 4 || not isValidOctal(get_arg(2)))
+    {
+        smash_error("chmod: invalid aruments");
+        return;
+    }
+    std::vector<std::string> roots(get_args().begin() + 3, get_args().end());
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    ParallelChmod walker(stoi(get_arg(2), nullptr, OCTAL), cores > 0 ? cores : 1);
+    walker.run(roots);
+    shell.out() << "chmod: changed mode of " << walker.getChanged() << " files, "
+                << walker.getFailed() << " failed" << endl;
+    if (walker.getFailed())
+    {
+        shell.setStatus(1);
+    }
+}
+
+void ExportCommand::execute()
+{
+    if (get_args().size() == 1)
+    {
+        for (char **entry = shell.getEnvironment().getEnvp(); *entry; entry++)
+        {
+            shell.out() << *entry << endl;
+        }
+        return;
+    }
+    for (size_t i = 1; i < get_args().size(); i++)
+    {
+        const string &arg = get_args()[i];
+        size_t eq = arg.find('=');
+        if (isAssignment(arg))
+        {
+            shell.exportVariable(arg.substr(0, eq), arg.substr(eq + 1));
+        }
+        else if (isAssignment(arg + "="))
+        {
+            // export NAME moves an existing shell variable into the environment
+            if (shell.isShellVariable(arg))
+            {
+                shell.exportVariable(arg, shell.getVariable(arg));
+            }
+        }
+        else
+        {
+            smash_error("export: invalid arguments");
+            return;
+        }
+    }
+}
+
+void UnsetCommand::execute()
+{
+    for (size_t i = 1; i < get_args().size(); i++)
+    {
+        shell.unsetVariable(get_args()[i]);
+    }
+}
+
+void EnvCommand::execute()
+{
+    for (char **entry = shell.getEnvironment().getEnvp(); *entry; entry++)
+    {
+        shell.out() << *entry << endl;
     }
 }
@@ -2,13 +2,29 @@
 #define SMASH_COMMAND_H_
 
 #include <vector>
+#include <map>
+#include <deque>
 #include <memory>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include "Arena.h"
+#include "EventLoop.h"
+#include "ParseCache.h"
+#include "Script.h"
+#include "Environment.h"
+#include "JobPlacer.h"
+#include "JobPriority.h"
+#include "JobLog.h"
+#include "Periodic.h"
+#include "JobGraph.h"
+#include "JobState.h"
 
 #define ERROR_PROMPT std::string("smash error: ")
 #define DEFAULT_PROMPT std::string("smash")
 #define PROMPT_SUFFIX std::string("> ")
 #define PID_IS std::string(" pid is ")
-#define MAX_JOBS 110
+#define MAX_JOBS 1024 // periodic tasks take a slot each
 #define COMMAND_ARGS_MAX_LENGTH (200)
 #define COMMAND_MAX_ARGS (20)
 #define MIN_SIGNUM 0
@@ -21,16 +37,21 @@
 #define OCTAL 8
 #define PIPE 1
 #define ERROR_FD -2
+#define WAIT_STATUS_UNKNOWN (1 << 8) // what waitForJob returns when it could not wait, reads as exit status 1
 
 class SmallShell;
 class Command {
 private:
-    std::string cmd_line;
+    std::shared_ptr<const ParsedCommand> parsed;
 protected:
-    std::string get_cmd_line(){return cmd_line;}
+    SmallShell &shell;
+    const std::string &get_cmd_line() const {return parsed->cmd_line;}
+    const std::vector<std::string> &get_args() const {return parsed->args;}
+    const std::string &get_arg(size_t n) const; // n-th word, "" if missing. 0 is the command itself
+    const ParsedCommand &get_parsed() const {return *parsed;}
     bool run_in_foreground();
 public:
-    Command(std::string cmd) : cmd_line(cmd + " ") {}
+    Command(SmallShell &shell, std::shared_ptr<const ParsedCommand> parsed) : parsed(parsed), shell(shell) {}
 
     virtual ~Command() = default;
 
@@ -39,22 +60,23 @@ public:
     //virtual void cleanup();
 
     virtual bool is_external() const {return false;}
-    virtual std::string get_name() const;
+    virtual const std::string &get_name() const;
 };
 
 class BuiltInCommand : public Command {
 protected:
     void smash_print(const std::string input);
     void smash_error(const std::string input);
+    void smash_perror(const std::string syscall);
 public:
-    BuiltInCommand(std::string cmd_line) : Command(cmd_line){};
+    BuiltInCommand(SmallShell &shell, std::shared_ptr<const ParsedCommand> parsed) : Command(shell, parsed){};
 
     ~BuiltInCommand() override = default;
 };
 
 class ExternalCommand : public Command {
 public:
-    ExternalCommand(std::string cmd_line) : Command(cmd_line) {};
+    ExternalCommand(SmallShell &shell, std::shared_ptr<const ParsedCommand> parsed) : Command(shell, parsed) {};
 
     virtual ~ExternalCommand() override = default;
 
@@ -66,7 +88,7 @@ public:
 class PipeCommand : public Command {
     // TODO: Add your data members
 public:
-    PipeCommand(std::string cmd_line);
+    PipeCommand(SmallShell &shell, std::shared_ptr<const ParsedCommand> parsed);
 
     virtual ~PipeCommand() {}
 
@@ -76,7 +98,7 @@ public:
 class RedirectionCommand : public Command {
     // TODO: Add your data members
 public:
-    explicit RedirectionCommand(std::string cmd_line);
+    RedirectionCommand(SmallShell &shell, std::shared_ptr<const ParsedCommand> parsed);
 
     virtual ~RedirectionCommand() {}
 
@@ -87,7 +109,7 @@ public:
 
 class ChangePromptCommand : public BuiltInCommand {
 public:
-    ChangePromptCommand(std::string cmd_line) : BuiltInCommand(cmd_line){};
+    ChangePromptCommand(SmallShell &shell, std::shared_ptr<const ParsedCommand> parsed) : BuiltInCommand(shell, parsed){};
 
     virtual ~ChangePromptCommand() {}
 
@@ -96,7 +118,7 @@ public:
 
 class ChangeDirCommand : public BuiltInCommand {
 public:
-    ChangeDirCommand(std::string cmd_line) : BuiltInCommand(cmd_line){}
+    ChangeDirCommand(SmallShell &shell, std::shared_ptr<const ParsedCommand> parsed) : BuiltInCommand(shell, parsed){}
 
     virtual ~ChangeDirCommand() = default;
 
@@ -105,7 +127,7 @@ public:
 
 class GetCurrDirCommand : public BuiltInCommand {
 public:
-    GetCurrDirCommand(std::string cmd_line) : BuiltInCommand(cmd_line) {}
+    GetCurrDirCommand(SmallShell &shell, std::shared_ptr<const ParsedCommand> parsed) : BuiltInCommand(shell, parsed) {}
 
     virtual ~GetCurrDirCommand() {}
 
@@ -114,7 +136,7 @@ public:
 
 class ShowPidCommand : public BuiltInCommand {
 public:
-    ShowPidCommand(std::string cmd_line) : BuiltInCommand(cmd_line) {}
+    ShowPidCommand(SmallShell &shell, std::shared_ptr<const ParsedCommand> parsed) : BuiltInCommand(shell, parsed) {}
 
     virtual ~ShowPidCommand() {}
 
@@ -125,7 +147,7 @@ class JobsList;
 
 class QuitCommand : public BuiltInCommand {
 public:
-    QuitCommand(std::string cmd_line) : BuiltInCommand(cmd_line) {}
+    QuitCommand(SmallShell &shell, std::shared_ptr<const ParsedCommand> parsed) : BuiltInCommand(shell, parsed) {}
 
     virtual ~QuitCommand() {}
 
@@ -140,39 +162,92 @@ public:
         int id;
         pid_t pid;
         std::string cmd;
+        std::vector<ResourceLimit> limits; // from the limit prefix
+        std::vector<int> cpus;             // affinity it was started with, empty if not placed
+        bool demoted;                      // started at background priority, fg promotes it
+        std::shared_ptr<JobLog> log;       // captured output, kept a while after the job (JOB_LOG_FINISHED_KEEP)
+        std::shared_ptr<PeriodicTask> periodic; // an every command, pid is 0 and its runs are jobs of their own
+        std::shared_ptr<PendingJob> pending;    // an after command that has not started, pid is 0
+        bool waited;                       // in the foreground, reaped by whoever waits for it
+        uint64_t start_ticks;              // its /proc start time, only read when there is a state file
+        bool adopted;                      // started by an earlier smash, not our child
+        bool exit_watched;                 // adopted, and a pidfd tells when it ends
+        bool ended;                        // adopted, and its pidfd reported the end
     public:
-        explicit JobEntry(int id, pid_t pid, std::string cmd) : id(id),pid(pid), cmd(cmd) {}
+        explicit JobEntry(int id, pid_t pid, const std::string &cmd, const std::vector<ResourceLimit> &limits,
+                          const std::vector<int> &cpus, bool demoted)
+                : id(id),pid(pid), cmd(cmd), limits(limits), cpus(cpus), demoted(demoted), waited(false),
+                  start_ticks(0), adopted(false), exit_watched(false), ended(false) {}
 //        JobEntry(JobEntry const &) = delete; //disable copy ctor
 
         int get_id() const;
         int get_pid() const;
         // bool is_deleted();
         std::string get_command_name();
+        const std::vector<ResourceLimit> &get_limits() const {return limits;}
+        const std::vector<int> &get_cpus() const {return cpus;}
+        bool is_demoted() const {return demoted;}
+        void set_demoted(bool demoted) {this->demoted = demoted;}
+        std::shared_ptr<JobLog> get_log() const {return log;}
+        void set_log(std::shared_ptr<JobLog> log) {this->log = log;}
+        std::shared_ptr<PeriodicTask> get_periodic() const {return periodic;}
+        void set_periodic(std::shared_ptr<PeriodicTask> periodic) {this->periodic = periodic;}
+        std::shared_ptr<PendingJob> get_pending() const {return pending;}
+        void set_pending(std::shared_ptr<PendingJob> pending) {this->pending = pending;}
+        bool has_process() const {return pid > 0;}
+        uint64_t get_start_ticks() const {return start_ticks;}
+        void set_start_ticks(uint64_t start_ticks) {this->start_ticks = start_ticks;}
+        bool is_adopted() const {return adopted;}
+        void set_adopted(bool adopted) {this->adopted = adopted;}
+        bool is_exit_watched() const {return exit_watched;}
+        void set_exit_watched(bool exit_watched) {this->exit_watched = exit_watched;}
+        bool has_ended() const {return ended;}
+        void set_ended(bool ended) {this->ended = ended;}
+        bool is_waited() const {return waited;}
+        void set_waited(bool waited) {this->waited = waited;}
         int operator==(JobEntry const &) const;
     };
 
     std::vector<std::shared_ptr<JobEntry>> jobs;
+    std::vector<std::string> reports; // limited jobs that were reaped and pending jobs that were dropped, until jobs shows them
+    std::vector<std::pair<pid_t, int>> exited; // wait statuses of reaped jobs, until the job graph took them
+    int reserved_id; // get_new_id hands out this one while it is set and free
+    JobStateTable *state; // every job with a process is mirrored here, if set
+    std::deque<std::pair<int, std::shared_ptr<JobLog>>> finished_logs; // job id and captured output of the last jobs that ended
 
     int get_new_id();
     void delete_job_by_pid(pid_t pid);
     void delete_job_by_id(int jobId);
     void delete_finished_jobs();
+    void keepLog(const JobEntry &job);
 public:
     JobsList();
 
     ~JobsList() = default; //TODO: memory management?
 
-    void addJob(std::string cmd, pid_t pid);
+    std::shared_ptr<JobEntry> addJob(const std::string &cmd, pid_t pid, const std::vector<ResourceLimit> &limits,
+                                     const std::vector<int> &cpus, bool demoted);
 
-    void printJobsList() const;
+    // CPU_SETSIZE entries, how many running jobs are pinned to each CPU
+    std::vector<unsigned int> cpuLoads() const;
 
-    void killAllJobs();
+    void printJobsList(std::ostream &out) const;
+
+    // prints, once, the limited jobs that have finished and what ended them, and the pending jobs that never started
+    void printReports(std::ostream &out);
+
+    void killAllJobs(std::ostream &out, const std::string &prompt);
 
     void removeFinishedJobs();
 
+    bool isFull() const;
+    // the next job added gets jobId, 0 to go back to the lowest free id
+    void reserveId(int jobId);
     std::shared_ptr<JobEntry> getJobById(int jobId);
     std::shared_ptr<JobEntry> getJobByPid(const int& jobPid) const;
     void removeJobById(int jobId);
+    // the captured output of job jobId if it ended recently, handed over once. null if there is none
+    std::shared_ptr<JobLog> takeFinishedLog(int jobId);
 
     std::shared_ptr<JobsList> getLastJob(int *lastJobId);
 
@@ -180,9 +255,73 @@ public:
     // TODO: Add extra methods or modify exisitng ones as needed
 };
 
+// only reached for a malformed limit prefix, a valid one runs as an ExternalCommand
+class LimitCommand : public BuiltInCommand {
+public:
+    LimitCommand(SmallShell &shell, std::shared_ptr<const ParsedCommand> parsed) : BuiltInCommand(shell, parsed){};
+
+    virtual ~LimitCommand() {}
+
+    void execute() override;
+};
+
+class SchedCommand : public BuiltInCommand {
+public:
+    SchedCommand(SmallShell &shell, std::shared_ptr<const ParsedCommand> parsed) : BuiltInCommand(shell, parsed){};
+
+    virtual ~SchedCommand() {}
+
+    void execute() override;
+};
+
+class BackgroundPriorityCommand : public BuiltInCommand {
+public:
+    BackgroundPriorityCommand(SmallShell &shell, std::shared_ptr<const ParsedCommand> parsed) : BuiltInCommand(shell, parsed){};
+
+    virtual ~BackgroundPriorityCommand() {}
+
+    void execute() override;
+};
+
+class CaptureCommand : public BuiltInCommand {
+public:
+    CaptureCommand(SmallShell &shell, std::shared_ptr<const ParsedCommand> parsed) : BuiltInCommand(shell, parsed){};
+
+    virtual ~CaptureCommand() {}
+
+    void execute() override;
+};
+
+class JobLogCommand : public BuiltInCommand {
+public:
+    JobLogCommand(SmallShell &shell, std::shared_ptr<const ParsedCommand> parsed) : BuiltInCommand(shell, parsed){};
+
+    virtual ~JobLogCommand() {}
+
+    void execute() override;
+};
+
+class EveryCommand : public BuiltInCommand {
+public:
+    EveryCommand(SmallShell &shell, std::shared_ptr<const ParsedCommand> parsed) : BuiltInCommand(shell, parsed){};
+
+    virtual ~EveryCommand() {}
+
+    void execute() override;
+};
+
+class AfterCommand : public BuiltInCommand {
+public:
+    AfterCommand(SmallShell &shell, std::shared_ptr<const ParsedCommand> parsed) : BuiltInCommand(shell, parsed){};
+
+    virtual ~AfterCommand() {}
+
+    void execute() override;
+};
+
 class JobsCommand : public BuiltInCommand {
 public:
-    JobsCommand(std::string cmd_line) : BuiltInCommand(cmd_line){};
+    JobsCommand(SmallShell &shell, std::shared_ptr<const ParsedCommand> parsed) : BuiltInCommand(shell, parsed){};
 
     virtual ~JobsCommand() {}
 
@@ -191,7 +330,7 @@ public:
 
 class KillCommand : public BuiltInCommand {
 public:
-    KillCommand(std::string cmd_line)  : BuiltInCommand(cmd_line){};
+    KillCommand(SmallShell &shell, std::shared_ptr<const ParsedCommand> parsed) : BuiltInCommand(shell, parsed){};
 
     virtual ~KillCommand() {}
 
@@ -200,7 +339,7 @@ public:
 
 class ForegroundCommand : public BuiltInCommand {
 public:
-    ForegroundCommand(std::string cmd_line)  : BuiltInCommand(cmd_line){};
+    ForegroundCommand(SmallShell &shell, std::shared_ptr<const ParsedCommand> parsed) : BuiltInCommand(shell, parsed){};
 
     virtual ~ForegroundCommand() {}
 
@@ -208,8 +347,10 @@ public:
 };
 
 class ChmodCommand : public BuiltInCommand {
+private:
+    void executeRecursive();
 public:
-    ChmodCommand(std::string cmd_line) : BuiltInCommand(cmd_line){};
+    ChmodCommand(SmallShell &shell, std::shared_ptr<const ParsedCommand> parsed) : BuiltInCommand(shell, parsed){};
 
     virtual ~ChmodCommand() {}
 
@@ -217,48 +358,219 @@ public:
 };
 
 
+class ExportCommand : public BuiltInCommand {
+public:
+    ExportCommand(SmallShell &shell, std::shared_ptr<const ParsedCommand> parsed) : BuiltInCommand(shell, parsed){};
+
+    virtual ~ExportCommand() {}
+
+    void execute() override;
+};
+
+class UnsetCommand : public BuiltInCommand {
+public:
+    UnsetCommand(SmallShell &shell, std::shared_ptr<const ParsedCommand> parsed) : BuiltInCommand(shell, parsed){};
+
+    virtual ~UnsetCommand() {}
+
+    void execute() override;
+};
+
+class EnvCommand : public BuiltInCommand {
+public:
+    EnvCommand(SmallShell &shell, std::shared_ptr<const ParsedCommand> parsed) : BuiltInCommand(shell, parsed){};
+
+    virtual ~EnvCommand() {}
+
+    void execute() override;
+};
+
+
+class PushdCommand : public BuiltInCommand {
+public:
+    PushdCommand(SmallShell &shell, std::shared_ptr<const ParsedCommand> parsed) : BuiltInCommand(shell, parsed){};
+
+    virtual ~PushdCommand() {}
+
+    void execute() override;
+};
+
+class PopdCommand : public BuiltInCommand {
+public:
+    PopdCommand(SmallShell &shell, std::shared_ptr<const ParsedCommand> parsed) : BuiltInCommand(shell, parsed){};
+
+    virtual ~PopdCommand() {}
+
+    void execute() override;
+};
+
+class DirsCommand : public BuiltInCommand {
+public:
+    DirsCommand(SmallShell &shell, std::shared_ptr<const ParsedCommand> parsed) : BuiltInCommand(shell, parsed){};
+
+    virtual ~DirsCommand() {}
+
+    void execute() override;
+};
+
+
+/**
+ * A directory the shell holds open (O_PATH) together with its canonical path,
+ * resolved once when the shell first entered it. Going back is one fchdir.
+ */
+struct DirHandle {
+    int fd;
+    std::string path;
+    DirHandle() : fd(-1) {}
+};
+
+/**
+ * Unbuffered stream buffer writing straight to a descriptor number. Builtins
+ * print through it instead of std::cout, so whatever is installed on fd 1/2 of
+ * the calling thread (a redirection, or a thread's private fd table, see
+ * SmallShell::isolateThread) receives the output.
+ */
+class FdStreamBuf : public std::streambuf {
+private:
+    int fd;
+protected:
+    int_type overflow(int_type c) override;
+    std::streamsize xsputn(const char *s, std::streamsize n) override;
+public:
+    explicit FdStreamBuf(int fd) : fd(fd) {}
+};
+
 class SmallShell {
 private:
     pid_t smash_pid;
     std::string prompt;
-    std::string prev_path;
+    DirHandle cwd;
+    DirHandle prev_dir;
+    std::vector<DirHandle> dir_stack; // pushd/popd, top is the back
+    EventLoop events;  // before jobsList, job logs unregister from it when they are destroyed
+    PeriodicScheduler scheduler;
+    JobGraph graph;
+    JobStateTable state;
     JobsList jobsList;
-    SmallShell(); // ctor
+    FdStreamBuf out_buf;
+    FdStreamBuf err_buf;
+    std::ostream out_stream;
+    std::ostream err_stream;
+    bool running;
+    ParseCache parseCache;
+    ScriptInterpreter interpreter;
+    std::map<std::string, std::string> variables; // shell variables, not passed to children
+    Environment environment;
+    int last_status;
+    JobPlacer placer;
+    JobPriority background_priority;
+    bool capture_output;  // background jobs write into a JobLog instead of the terminal
+    size_t capture_size;  // ring buffer per job
+    Arena arena;     // per-command scratch, rewound when the outermost command returns
+    int exec_depth;  // nesting of executeParsed, commands may start others while waiting
+    pid_t last_background_pid;
+    int outer_stdout; // smash's own stdout while the outermost redirection is in place, else -1
     void delete_finished_jobs();
-    int setIO(std::string cmd_line);
+    int setIO(const ParsedCommand &parsed);
     void defaultIO(int cout_fd);
     int setPipe(int redirection_type, std::string cmd_line);
     std::string trim_for_pipe(std::string cmd_line);
+    bool openDir(const std::string &path, DirHandle &dir);
+    bool enterDir(DirHandle &dir);
+    void closeDir(DirHandle &dir);
     // int get_redirection_type(std::string cmd_line, __SIZE_TYPE__ pos, bool pipe=false);
 public:
+    std::shared_ptr<const ParsedCommand> parseCommand(const std::string &cmd_line);
+    std::shared_ptr<Command> CreateCommand(std::shared_ptr<const ParsedCommand> parsed);
     std::shared_ptr<Command> CreateCommand(std::string cmd_line);
 
+    SmallShell(); // ctor, every instance is an independent shell. one per thread, see libsmash.h
     SmallShell(SmallShell const &) = delete; // disable copy ctor
     void operator=(SmallShell const &) = delete; // disable = operator
-    static SmallShell &getInstance() // make SmallShell singleton
+    static SmallShell &getInstance() // the instance driven by the smash binary
     {
         static SmallShell instance; // Guaranteed to be destroyed.
         // Instantiated on first use.
         return instance;
     }
+    // gives the calling thread its own cwd and fd table, so a shell running on
+    // it can cd and redirect without affecting shells on other threads.
+    static bool isolateThread();
 
 
     ~SmallShell();
 
-    void executeCommand(std::string cmd_line);
+    void executeCommand(const std::string &cmd_line);
+    // a line from a source other than stdin, whose unfinished blocks are kept in its own interpreter
+    void executeCommand(const std::string &cmd_line, ScriptInterpreter &source);
+    int executeParsed(std::shared_ptr<const ParsedCommand> parsed, const std::string &cmd_line);
+    // producer |> { consumers }, returns its $?
+    int executeFanOut(const std::string &cmd_line);
 
     void smash_print(const std::string input);
     void smash_error(const std::string input);
     void setCurrentPrompt(const std::string &new_prompt);
     const std::string &getCurrentPrompt() const;
     int get_num_jobs() const;
-    void printJobs() const;
+    void printJobs();
     void killall();
     std::shared_ptr<JobsList::JobEntry> getJobById(int Id);
     pid_t getPidById(int Id);
-    std::string &getPrevPath();
-    void addJob(std::string cmd, pid_t pid);
+    pid_t signalJob(int Id, int signum);
+    const JobsList &getJobs() const;
+    JobsList &getJobs();
+    void removeFinishedJobs();
+    EventLoop &getEventLoop();
+    const ParseCache &getParseCache() const;
+    Arena &getArena();
+    int getStatus() const;
+    void setStatus(int status);
+    std::string getVariable(const std::string &name) const;
+    void setVariable(const std::string &name, const std::string &value);
+    void exportVariable(const std::string &name, const std::string &value);
+    void unsetVariable(const std::string &name);
+    bool isShellVariable(const std::string &name) const;
+    Environment &getEnvironment();
+    std::ostream &out();
+    std::ostream &err();
+    void quit();
+    bool isRunning() const;
+    const std::string &getCurrentDir() const;
+    bool hasPrevDir() const;
+    // these return false with errno set when the directory can't be entered
+    bool changeDir(const std::string &path);
+    bool changeToPrevDir();
+    bool pushDir(const std::string &path);
+    bool rotateDirs(); // pushd without arguments, swaps cwd and the top of the stack
+    bool popDir();
+    const std::vector<DirHandle> &getDirStack() const;
+    std::shared_ptr<JobsList::JobEntry> addJob(const std::string &cmd, pid_t pid,
+                                               const std::vector<ResourceLimit> &limits = std::vector<ResourceLimit>(),
+                                               const std::vector<int> &cpus = std::vector<int>(), bool demoted = false);
+    // waits for a foreground job while still serving the nested event loop watches, returns the wait status
+    int waitForJob(pid_t pid);
+    bool isCapturing() const;
+    size_t getCaptureSize() const;
+    void setCapture(bool capture, size_t size);
+    // the CPUs a new job should be pinned to, empty to leave its affinity alone
+    std::vector<int> placeJob(const ParsedCommand &parsed);
+    JobPlacer &getJobPlacer();
+    JobPriority &getBackgroundPriority();
     void deleteJob(pid_t pid);
+    PeriodicScheduler &getScheduler();
+    void setLastBackgroundPid(pid_t pid);
+    // runs cmd_line as a background command from wherever the shell is, even in the middle of
+    // a redirected foreground command, as job job_id if that is given and free. returns the
+    // job's pid, 0 if it was not an external command, -1 if it could not be started. the $? the
+    // line left goes to line_status if given, that is how a builtin, which ran to completion, did
+    pid_t startBackground(const std::string &cmd_line, int job_id = 0, int *line_status = nullptr);
+    JobGraph &getJobGraph();
+    // false if Id is not a periodic or pending job. otherwise it is removed, the runs of a periodic job get signum
+    bool cancelScheduled(int Id, int signum);
+    // opens the state file, adopts the jobs in it that are still running and keeps it up to date from now on
+    bool restoreJobs(const std::string &path);
+    // in a child forked to run more commands: the event loop watches and the state file stay the parent's
+    void detachFromParent();
 };
 
 #endif //SMASH_COMMAND_H_
@@ -0,0 +1,311 @@
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sstream>
+#include "ControlSocket.h"
+#include "Commands.h"
+
+using namespace std;
+
+static uint32_t decode_length(const string &buf)
+{
+    const unsigned char *p = (const unsigned char *)buf.data();
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static void append_frame(string &out, const string &payload)
+{
+    uint32_t len = payload.size();
+    char header[CONTROL_HEADER_SIZE] = {(char)(len >> 24), (char)(len >> 16), (char)(len >> 8), (char)len};
+    out.append(header, CONTROL_HEADER_SIZE);
+    out.append(payload);
+}
+
+static string ok(const string &body)
+{
+    return "ok\n" + body;
+}
+
+static string error(const string &message)
+{
+    return "error\n" + message;
+}
+
+ControlSocket::~ControlSocket()
+{
+    while (not connections.empty())
+    {
+        closeConnection(connections.begin()->first);
+    }
+    if (listen_fd >= 0)
+    {
+        shell.getEventLoop().remove(listen_fd);
+        close(listen_fd);
+        unlink(path.c_str());
+    }
+}
+
+bool ControlSocket::listen()
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(addr.sun_path))
+    {
+        shell.smash_error("listen: invalid socket path");
+        return false;
+    }
+    strcpy(addr.sun_path, path.c_str());
+
+    // a stale socket from a previous run would make bind fail, anything else is left alone
+    struct stat st;
+    if (lstat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+    {
+        unlink(path.c_str());
+    }
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0)
+    {
+        perror("smash error: socket failed");
+        return false;
+    }
+    if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        perror("smash error: bind failed");
+        close(listen_fd);
+        listen_fd = -1;
+        return false;
+    }
+    if (::listen(listen_fd, CONTROL_BACKLOG) < 0)
+    {
+        perror("smash error: listen failed");
+        close(listen_fd);
+        listen_fd = -1;
+        return false;
+    }
+    shell.getEventLoop().add(listen_fd, POLLIN, [this](int, short) { onAccept(); });
+    return true;
+}
+
+void ControlSocket::onAccept()
+{
+    while (true)
+    {
+        int fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            {
+                perror("smash error: accept failed");
+            }
+            return;
+        }
+        connections[fd] = Connection{fd, string(), string(), false};
+        shell.getEventLoop().add(fd, POLLIN, [this](int fd, short revents) { onEvent(fd, revents); });
+    }
+}
+
+void ControlSocket::onEvent(int fd, short revents)
+{
+    auto it = connections.find(fd);
+    if (it == connections.end()) return;
+    Connection &conn = it->second;
+
+    if (revents & POLLOUT)
+    {
+        if (not flush(conn) || (conn.closing && conn.out.empty()))
+        {
+            closeConnection(fd);
+            return;
+        }
+    }
+    if (not conn.closing && (revents & (POLLIN | POLLHUP | POLLERR)))
+    {
+        bool open = readFrom(conn);
+        // answer everything that arrived complete, even if the peer already hung up
+        dispatch(conn);
+        if (not flush(conn) || not open || (conn.closing && conn.out.empty()))
+        {
+            closeConnection(fd);
+            return;
+        }
+    }
+    // a closing connection is not read from anymore, only its last answer is sent
+    shell.getEventLoop().modify(fd, conn.closing ? POLLOUT : conn.out.empty() ? POLLIN : (POLLIN | POLLOUT));
+}
+
+bool ControlSocket::readFrom(Connection &conn)
+{
+    char buf[4096];
+    while (true)
+    {
+        ssize_t n = read(conn.fd, buf, sizeof(buf));
+        if (n > 0)
+        {
+            conn.in.append(buf, n);
+            continue;
+        }
+        if (n == 0) return false;
+        if (errno == EINTR) continue;
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+}
+
+bool ControlSocket::flush(Connection &conn)
+{
+    while (not conn.out.empty())
+    {
+        ssize_t n = send(conn.fd, conn.out.data(), conn.out.size(), MSG_NOSIGNAL);
+        if (n < 0)
+        {
+            if (errno == EINTR) continue;
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        conn.out.erase(0, n);
+    }
+    return true;
+}
+
+void ControlSocket::dispatch(Connection &conn)
+{
+    size_t pos = 0;
+    while (conn.in.size() - pos >= CONTROL_HEADER_SIZE)
+    {
+        uint32_t len = decode_length(conn.in.substr(pos, CONTROL_HEADER_SIZE));
+        if (len > CONTROL_MAX_REQUEST)
+        {
+            append_frame(conn.out, error("request too large"));
+            pos = conn.in.size();
+            conn.closing = true;
+            break;
+        }
+        if (conn.in.size() - pos - CONTROL_HEADER_SIZE < len) break;
+        string request = conn.in.substr(pos + CONTROL_HEADER_SIZE, len);
+        pos += CONTROL_HEADER_SIZE + len;
+        append_frame(conn.out, handle(request));
+    }
+    conn.in.erase(0, pos);
+}
+
+void ControlSocket::closeConnection(int fd)
+{
+    shell.getEventLoop().remove(fd);
+    close(fd);
+    connections.erase(fd);
+}
+
+std::string ControlSocket::handle(const std::string &request)
+{
+    string verb = request.substr(0, request.find_first_of(" \n"));
+    string args = (verb.size() < request.size()) ? request.substr(verb.size() + 1) : string();
+    if (verb == "run")
+    {
+        return runCommand(args);
+    }
+    else if (verb == "jobs")
+    {
+        return listJobs();
+    }
+    else if (verb == "kill")
+    {
+        return killJob(args);
+    }
+    return error("unknown request: " + verb);
+}
+
+std::string ControlSocket::runCommand(const std::string &cmd_line)
+{
+    int capture = memfd_create("smash-run", MFD_CLOEXEC);
+    if (capture < 0)
+    {
+        return error(string("memfd_create failed: ") + strerror(errno));
+    }
+    fflush(stdout);
+    int saved_out = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 0);
+    int saved_err = fcntl(STDERR_FILENO, F_DUPFD_CLOEXEC, 0);
+    dup2(capture, STDOUT_FILENO);
+    dup2(capture, STDERR_FILENO);
+
+    shell.executeCommand(cmd_line, interpreter);
+    bool incomplete = interpreter.inBlock();
+    interpreter.reset();
+
+    fflush(stdout);
+    dup2(saved_out, STDOUT_FILENO);
+    dup2(saved_err, STDERR_FILENO);
+    close(saved_out);
+    close(saved_err);
+
+    string output;
+    char buf[4096];
+    ssize_t n;
+    lseek(capture, 0, SEEK_SET);
+    while ((n = read(capture, buf, sizeof(buf))) > 0)
+    {
+        output.append(buf, n);
+    }
+    close(capture);
+    if (incomplete)
+    {
+        return error("run: incomplete statement");
+    }
+    return ok(output);
+}
+
+std::string ControlSocket::listJobs()
+{
+    shell.removeFinishedJobs();
+    string body;
+    for (auto &job : shell.getJobs().jobs)
+    {
+        if (job)
+        {
+            body += to_string(job->get_id()) + "\t" + to_string(job->get_pid()) + "\t" +
+                    job->get_command_name() + "\n";
+        }
+    }
+    return ok(body);
+}
+
+std::string ControlSocket::killJob(const std::string &args)
+{
+    istringstream iss(args);
+    string signum_s, job_s, extra;
+    iss >> signum_s >> job_s;
+    if (signum_s.empty() || job_s.empty() || (iss >> extra))
+    {
+        return error("kill: invalid arguments");
+    }
+    if (signum_s[0] == '-') signum_s.erase(0, 1);
+    int signum, job_id;
+    try
+    {
+        signum = stoi(signum_s);
+        job_id = stoi(job_s);
+    }
+    catch (const std::exception &)
+    {
+        return error("kill: invalid arguments");
+    }
+    if (signum < MIN_SIGNUM || signum > MAX_SIGNUM)
+    {
+        return error("kill: invalid arguments");
+    }
+    if (shell.cancelScheduled(job_id, signum))
+    {
+        return ok("cancelled\n");
+    }
+    pid_t pid = shell.signalJob(job_id, signum);
+    if (pid == 0)
+    {
+        return error("kill: job-id " + to_string(job_id) + " does not exist");
+    }
+    return ok(to_string(pid) + "\t" + to_string(signum) + "\n");
+}
@@ -0,0 +1,71 @@
+#ifndef SMASH_CONTROL_SOCKET_H_
+#define SMASH_CONTROL_SOCKET_H_
+
+#include <map>
+#include <string>
+#include <stdint.h>
+#include "Script.h"
+
+#define CONTROL_HEADER_SIZE 4
+#define CONTROL_MAX_REQUEST (1 << 20)
+#define CONTROL_BACKLOG 16
+
+class SmallShell;
+
+/**
+ * UNIX-domain control socket served from the shell's event loop
+ * (smash --listen PATH).
+ *
+ * Every frame in both directions is a 4 byte big-endian length followed by the
+ * payload. A connection may send any number of requests without waiting for
+ * the answers; responses are written back in order.
+ *
+ * requests:
+ *   run <command line>     executes the line, the body is its stdout+stderr. a
+ *                          for/while/if has to be complete within the request
+ *   jobs                   one "<id>\t<pid>\t<command>" line per job
+ *   kill <signum> <job-id> body is "<pid>\t<signum>"
+ *
+ * responses: "ok\n<body>" or "error\n<message>". A frame longer than
+ * CONTROL_MAX_REQUEST is answered with an error and the connection is closed,
+ * the stream can't be resynchronised after it.
+ *
+ * Requests are handled one at a time on the shell's thread: a run request
+ * holds up the prompt and every other connection until its command returns,
+ * so a long command should be run in the background ("run cmd&").
+ */
+class ControlSocket {
+private:
+    struct Connection {
+        int fd;
+        std::string in;
+        std::string out;
+        bool closing; // sent an error it can't recover from, closed once out is flushed
+    };
+    SmallShell &shell;
+    std::string path;
+    int listen_fd;
+    std::map<int, Connection> connections;
+    ScriptInterpreter interpreter; // run requests are whole statements, apart from the lines typed at the prompt
+
+    void onAccept();
+    void onEvent(int fd, short revents);
+    bool readFrom(Connection &conn);
+    bool flush(Connection &conn);
+    void dispatch(Connection &conn);
+    void closeConnection(int fd);
+
+    std::string handle(const std::string &request);
+    std::string runCommand(const std::string &cmd_line);
+    std::string listJobs();
+    std::string killJob(const std::string &args);
+public:
+    ControlSocket(SmallShell &shell, const std::string &path) : shell(shell), path(path), listen_fd(-1), interpreter(shell) {}
+    ControlSocket(ControlSocket const &) = delete;
+    void operator=(ControlSocket const &) = delete;
+    ~ControlSocket();
+
+    bool listen();
+};
+
+#endif //SMASH_CONTROL_SOCKET_H_
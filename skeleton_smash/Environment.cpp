@@ -0,0 +1,97 @@
+#include <string.h>
+#include <unistd.h>
+#include "Environment.h"
+
+extern char **environ;
+
+Environment::Environment() : dirty(true), version(0)
+{
+    for (char **entry = environ; entry && *entry; entry++)
+    {
+        const char *eq = strchr(*entry, '=');
+        if (eq)
+        {
+            vars[std::string(*entry, eq - *entry)] = std::string(eq + 1);
+        }
+    }
+}
+
+void Environment::set(const std::string &name, const std::string &value)
+{
+    vars[name] = value;
+    dirty = true;
+    version++;
+}
+
+void Environment::unset(const std::string &name)
+{
+    if (vars.erase(name))
+    {
+        dirty = true;
+        version++;
+    }
+}
+
+bool Environment::get(const std::string &name, std::string &value) const
+{
+    auto found = vars.find(name);
+    if (found == vars.end()) return false;
+    value = found->second;
+    return true;
+}
+
+void Environment::rebuild()
+{
+    entries.clear();
+    envp.clear();
+    entries.reserve(vars.size());
+    for (auto &var : vars)
+    {
+        entries.push_back(var.first + "=" + var.second);
+    }
+    for (std::string &entry : entries)
+    {
+        envp.push_back(&entry[0]);
+    }
+    envp.push_back(nullptr);
+    dirty = false;
+}
+
+char **Environment::getEnvp()
+{
+    if (dirty)
+    {
+        rebuild();
+    }
+    return envp.data();
+}
+
+char **Environment::overlay(const std::vector<std::string> &assignments, Arena &arena)
+{
+    char **entries = getEnvp();
+    char **result = arena.allocateArray<char*>(envp.size() + assignments.size());
+    size_t count = 0;
+    for (char **entry = entries; *entry; entry++)
+    {
+        size_t name_length = strchr(*entry, '=') - *entry + 1; // including the '='
+        bool overridden = false;
+        for (const std::string &assignment : assignments)
+        {
+            if (assignment.compare(0, name_length, *entry, name_length) == 0)
+            {
+                overridden = true;
+                break;
+            }
+        }
+        if (not overridden)
+        {
+            result[count++] = *entry;
+        }
+    }
+    for (const std::string &assignment : assignments)
+    {
+        result[count++] = const_cast<char*>(assignment.c_str());
+    }
+    result[count] = nullptr;
+    return result;
+}
@@ -0,0 +1,43 @@
+#ifndef SMASH_ENVIRONMENT_H_
+#define SMASH_ENVIRONMENT_H_
+
+#include <map>
+#include <string>
+#include <vector>
+#include "Arena.h"
+
+/**
+ * The exported variables of a shell. Children get getEnvp() handed straight
+ * to execve; the array is rebuilt lazily, only after a variable changed.
+ */
+class Environment {
+private:
+    std::map<std::string, std::string> vars;
+    std::vector<std::string> entries; // "NAME=value", backing storage of envp
+    std::vector<char*> envp;
+    bool dirty;
+    unsigned long version;
+
+    void rebuild();
+public:
+    Environment(); // starts from the process environment
+    Environment(Environment const &) = delete;
+    void operator=(Environment const &) = delete;
+
+    void set(const std::string &name, const std::string &value);
+    void unset(const std::string &name);
+    bool get(const std::string &name, std::string &value) const;
+
+    // NULL terminated, valid until the next set/unset
+    char **getEnvp();
+
+    // envp with NAME=value overrides layered on top. only the pointer array is
+    // built, in the arena; the strings are shared with the store and with the
+    // overrides.
+    char **overlay(const std::vector<std::string> &assignments, Arena &arena);
+
+    // bumped on every change, lets callers notice e.g. a new PATH
+    unsigned long getVersion() const { return version; }
+};
+
+#endif //SMASH_ENVIRONMENT_H_
@@ -0,0 +1,91 @@
+#include <errno.h>
+#include <stdio.h>
+#include <algorithm>
+#include "EventLoop.h"
+
+void EventLoop::add(int fd, short events, Handler handler, bool nested)
+{
+    remove(fd);
+    watches.push_back(std::make_shared<Watch>(Watch{fd, events, handler, nested, false}));
+}
+
+void EventLoop::modify(int fd, short events)
+{
+    for (auto &watch : watches)
+    {
+        if (watch->fd == fd && not watch->removed)
+        {
+            watch->events = events;
+        }
+    }
+}
+
+void EventLoop::remove(int fd)
+{
+    // entries are only flagged here, runOnce() may still be iterating them.
+    for (auto &watch : watches)
+    {
+        if (watch->fd == fd)
+        {
+            watch->removed = true;
+        }
+    }
+}
+
+void EventLoop::clear()
+{
+    for (auto &watch : watches)
+    {
+        watch->removed = true;
+    }
+}
+
+bool EventLoop::empty() const
+{
+    for (auto &watch : watches)
+    {
+        if (not watch->removed)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+int EventLoop::runOnce(int timeout_ms, bool nested_only)
+{
+    watches.erase(std::remove_if(watches.begin(), watches.end(),
+                                 [](const std::shared_ptr<Watch> &w) { return w->removed; }),
+                  watches.end());
+
+    // snapshot, handlers are allowed to add and remove watches
+    std::vector<std::shared_ptr<Watch>> current;
+    std::vector<struct pollfd> fds;
+    for (auto &watch : watches)
+    {
+        if (watch->nested || not nested_only)
+        {
+            current.push_back(watch);
+            fds.push_back({watch->fd, watch->events, 0});
+        }
+    }
+
+    int ready = poll(fds.data(), fds.size(), timeout_ms);
+    if (ready < 0)
+    {
+        if (errno == EINTR) return 0;
+        perror("smash error: poll failed");
+        return -1;
+    }
+
+    int called = 0;
+    for (size_t i = 0; i < fds.size() && ready > 0; i++)
+    {
+        if (fds[i].revents == 0) continue;
+        ready--;
+        if (current[i]->removed) continue;
+        current[i]->handler(fds[i].fd, fds[i].revents);
+        called++;
+    }
+    return called;
+}
@@ -0,0 +1,47 @@
+#ifndef SMASH_EVENT_LOOP_H_
+#define SMASH_EVENT_LOOP_H_
+
+#include <functional>
+#include <memory>
+#include <vector>
+#include <poll.h>
+
+/**
+ * A minimal poll(2) based dispatcher. The main loop pumps it while waiting for
+ * the next command line, so every other source of work (the control socket,
+ * and later job related descriptors) is served from the same thread.
+ * Watches added with nested=true are also served while a foreground command
+ * is being waited for; the others (stdin, the control socket) start commands
+ * of their own and wait for the prompt.
+ */
+class EventLoop {
+public:
+    typedef std::function<void(int fd, short revents)> Handler;
+private:
+    struct Watch {
+        int fd;
+        short events;
+        Handler handler;
+        bool nested;
+        bool removed;
+    };
+    std::vector<std::shared_ptr<Watch>> watches;
+public:
+    EventLoop() = default;
+    EventLoop(EventLoop const &) = delete;
+    void operator=(EventLoop const &) = delete;
+
+    void add(int fd, short events, Handler handler, bool nested = false);
+    void modify(int fd, short events);
+    void remove(int fd);
+    // drops every watch, for a forked child that must leave the parent's descriptors alone
+    void clear();
+    bool empty() const;
+
+    // polls once (timeout_ms < 0 blocks) and dispatches ready handlers, only
+    // the nested ones if nested_only. returns the number of handlers that were
+    // called, or -1 on error.
+    int runOnce(int timeout_ms, bool nested_only = false);
+};
+
+#endif //SMASH_EVENT_LOOP_H_
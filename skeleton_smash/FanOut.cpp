@@ -0,0 +1,327 @@
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <algorithm>
+#include <sstream>
+#include "FanOut.h"
+#include "Commands.h"
+
+static std::string _trimWords(const std::string &text)
+{
+    size_t start = text.find_first_not_of(" \n\r\t\f\v");
+    size_t end = text.find_last_not_of(" \n\r\t\f\v");
+    return start == std::string::npos ? std::string() : text.substr(start, end - start + 1);
+}
+
+// a smash child running line with the given stdin/stdout, like the two sides of setPipe
+static pid_t _spawn(SmallShell &shell, const std::string &line, int in_fd, int out_fd, const std::vector<int> &pipe_fds)
+{
+    pid_t pid = fork();
+    if (pid != 0)
+    {
+        return pid;
+    }
+    signal(SIGPIPE, SIG_DFL);
+    if (in_fd != -1) dup2(in_fd, STDIN_FILENO);
+    if (out_fd != -1) dup2(out_fd, STDOUT_FILENO);
+    for (int fd : pipe_fds)
+    {
+        close(fd);
+    }
+    // the parent's job logs, sockets and state file are the parent's to serve
+    shell.detachFromParent();
+    shell.executeCommand(line);
+    _exit(shell.getStatus());
+}
+
+FanOut::FanOut(SmallShell &shell) : shell(shell), source(-1), source_watched(false), devnull(-1), chunk(FANOUT_CHUNK)
+{
+}
+
+FanOut::~FanOut()
+{
+    closeSource();
+    for (Consumer &consumer : consumers)
+    {
+        closeConsumer(consumer);
+    }
+    if (devnull != -1)
+    {
+        close(devnull);
+    }
+}
+
+bool FanOut::matches(const std::string &cmd_line)
+{
+    return cmd_line.find(FANOUT_OPERATOR) != std::string::npos;
+}
+
+bool FanOut::parse(const std::string &cmd_line, std::string &producer, std::vector<std::string> &consumers)
+{
+    size_t op = cmd_line.find(FANOUT_OPERATOR);
+    producer = _trimWords(cmd_line.substr(0, op));
+    std::string group = _trimWords(cmd_line.substr(op + strlen(FANOUT_OPERATOR)));
+    if (producer.empty() || group.size() < 2 || group.front() != '{' || group.back() != '}')
+    {
+        return false;
+    }
+    consumers.clear();
+    std::istringstream parts(group.substr(1, group.size() - 2));
+    for (std::string part; std::getline(parts, part, ';'); )
+    {
+        part = _trimWords(part);
+        if (not part.empty())
+        {
+            consumers.push_back(part);
+        }
+    }
+    return not consumers.empty();
+}
+
+int FanOut::run(const std::string &producer, const std::vector<std::string> &lines)
+{
+    // every pipe is made before the first fork so each child can close all the others
+    std::vector<int> pipe_fds;
+    int source_pipe[2];
+    if (pipe2(source_pipe, O_CLOEXEC) == -1)
+    {
+        perror("smash error: pipe failed");
+        return 1;
+    }
+    pipe_fds.push_back(source_pipe[0]);
+    pipe_fds.push_back(source_pipe[1]);
+    std::vector<int> consumer_reads;
+    for (size_t i = 0; i < lines.size(); i++)
+    {
+        int consumer_pipe[2];
+        if (pipe2(consumer_pipe, O_CLOEXEC) == -1)
+        {
+            perror("smash error: pipe failed");
+            for (int fd : pipe_fds) close(fd);
+            return 1;
+        }
+        fcntl(consumer_pipe[1], F_SETPIPE_SZ, FANOUT_PIPE_SIZE);
+        pipe_fds.push_back(consumer_pipe[0]);
+        pipe_fds.push_back(consumer_pipe[1]);
+        consumer_reads.push_back(consumer_pipe[0]);
+        consumers.push_back(Consumer{consumer_pipe[1], std::string(), 0, -1});
+    }
+    source = source_pipe[0];
+    devnull = open("/dev/null", O_WRONLY | O_CLOEXEC);
+
+    pid_t producer_pid = _spawn(shell, producer, -1, source_pipe[1], pipe_fds);
+    for (size_t i = 0; i < lines.size(); i++)
+    {
+        consumers[i].pid = _spawn(shell, lines[i], consumer_reads[i], -1, pipe_fds);
+    }
+    // only smash's ends stay open here
+    close(source_pipe[1]);
+    for (int fd : consumer_reads)
+    {
+        close(fd);
+    }
+    fcntl(source, F_SETFL, fcntl(source, F_GETFL) | O_NONBLOCK);
+    for (Consumer &consumer : consumers)
+    {
+        fcntl(consumer.fd, F_SETFL, fcntl(consumer.fd, F_GETFL) | O_NONBLOCK);
+    }
+
+    // a consumer that exits early must not take smash down with it
+    struct sigaction ignore, previous;
+    memset(&ignore, 0, sizeof(ignore));
+    ignore.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &ignore, &previous);
+    updateWatches();
+    while (not done() && shell.getEventLoop().runOnce(-1, true) >= 0) {}
+    sigaction(SIGPIPE, &previous, nullptr);
+    closeSource();
+    for (Consumer &consumer : consumers)
+    {
+        closeConsumer(consumer);
+    }
+
+    int status = 0;
+    if (producer_pid > 0)
+    {
+        shell.waitForJob(producer_pid);
+    }
+    for (Consumer &consumer : consumers)
+    {
+        if (consumer.pid > 0)
+        {
+            status = shell.waitForJob(consumer.pid);
+        }
+    }
+    return status;
+}
+
+void FanOut::pump(short revents)
+{
+    int available = 0;
+    ioctl(source, FIONREAD, &available);
+    if (available == 0)
+    {
+        if (revents & (POLLHUP | POLLERR))
+        {
+            closeSource(); // the producer is done
+        }
+        updateWatches();
+        return;
+    }
+    size_t length = std::min((size_t)available, chunk.size());
+    bool copy = false;
+    for (Consumer &consumer : consumers)
+    {
+        consumer.sent = 0;
+        if (consumer.fd == -1)
+        {
+            continue;
+        }
+        if (not consumer.spill.empty())
+        {
+            copy = true; // behind already, keep its bytes in order
+            continue;
+        }
+        ssize_t n = tee(source, consumer.fd, length, SPLICE_F_NONBLOCK);
+        if (n < 0 && errno == EPIPE)
+        {
+            closeConsumer(consumer);
+            continue;
+        }
+        consumer.sent = std::max<ssize_t>(n, 0);
+        copy = copy || consumer.sent < length;
+    }
+    if (copy)
+    {
+        ssize_t n = read(source, chunk.data(), length);
+        length = std::max<ssize_t>(n, 0);
+        for (Consumer &consumer : consumers)
+        {
+            if (consumer.fd != -1 && consumer.sent < length)
+            {
+                consumer.spill.append(chunk.data() + consumer.sent, length - consumer.sent);
+            }
+        }
+    }
+    else
+    {
+        // every consumer has its copy, drop the chunk without reading it
+        for (size_t dropped = 0; dropped < length; )
+        {
+            ssize_t n = splice(source, nullptr, devnull, nullptr, length - dropped, SPLICE_F_NONBLOCK);
+            if (n <= 0) break;
+            dropped += n;
+        }
+    }
+    if (std::all_of(consumers.begin(), consumers.end(), [](const Consumer &c) { return c.fd == -1; }))
+    {
+        closeSource(); // nobody is listening, let the producer get SIGPIPE
+    }
+    for (Consumer &consumer : consumers)
+    {
+        flush(consumer);
+    }
+    updateWatches();
+}
+
+void FanOut::flush(Consumer &consumer)
+{
+    while (consumer.fd != -1 && not consumer.spill.empty())
+    {
+        ssize_t n = write(consumer.fd, consumer.spill.data(), consumer.spill.size());
+        if (n < 0)
+        {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN) closeConsumer(consumer);
+            break;
+        }
+        consumer.spill.erase(0, n);
+    }
+    if (source == -1 && consumer.spill.empty())
+    {
+        closeConsumer(consumer); // everything delivered, the consumer sees EOF
+    }
+}
+
+void FanOut::closeConsumer(Consumer &consumer)
+{
+    if (consumer.fd != -1)
+    {
+        shell.getEventLoop().remove(consumer.fd);
+        close(consumer.fd);
+        consumer.fd = -1;
+    }
+    consumer.spill.clear();
+}
+
+void FanOut::closeSource()
+{
+    if (source != -1)
+    {
+        shell.getEventLoop().remove(source);
+        close(source);
+        source = -1;
+        source_watched = false;
+    }
+}
+
+void FanOut::updateWatches()
+{
+    EventLoop &events = shell.getEventLoop();
+    if (source == -1)
+    {
+        for (Consumer &consumer : consumers)
+        {
+            flush(consumer);
+        }
+    }
+    bool throttled = false;
+    for (Consumer &consumer : consumers)
+    {
+        throttled = throttled || consumer.spill.size() > FANOUT_SPILL_LIMIT;
+        if (consumer.fd == -1)
+        {
+            continue;
+        }
+        if (consumer.spill.empty())
+        {
+            events.remove(consumer.fd);
+        }
+        else
+        {
+            Consumer *target = &consumer;
+            events.add(consumer.fd, POLLOUT, [this, target](int, short) { flush(*target); updateWatches(); }, true);
+        }
+    }
+    if (source != -1 && throttled == source_watched)
+    {
+        if (throttled)
+        {
+            events.remove(source);
+        }
+        else
+        {
+            events.add(source, POLLIN, [this](int, short revents) { pump(revents); }, true);
+        }
+        source_watched = not throttled;
+    }
+}
+
+bool FanOut::done() const
+{
+    if (source != -1)
+    {
+        return false;
+    }
+    for (const Consumer &consumer : consumers)
+    {
+        if (consumer.fd != -1)
+        {
+            return false;
+        }
+    }
+    return true;
+}
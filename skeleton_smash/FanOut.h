@@ -0,0 +1,61 @@
+#ifndef SMASH_FAN_OUT_H_
+#define SMASH_FAN_OUT_H_
+
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+#define FANOUT_OPERATOR "|>"
+#define FANOUT_CHUNK (64 * 1024)
+#define FANOUT_PIPE_SIZE (1024 * 1024)    // asked for on every consumer pipe, the kernel may cap it
+#define FANOUT_SPILL_LIMIT (1024 * 1024)  // per consumer, beyond it the producer is throttled
+
+class SmallShell;
+
+/**
+ * producer |> { consumer1 ; consumer2 ; ... }
+ *
+ * Every consumer reads its own pipe. smash duplicates the producer's pipe into
+ * them with tee(2) and then discards the chunk with splice(2), so the data is
+ * never copied through smash. A consumer whose pipe is full gets the bytes it
+ * could not take appended to its own spill queue instead (the one path that
+ * does copy), and the producer is only held back once some consumer's spill
+ * passes FANOUT_SPILL_LIMIT: a slow consumer does not stall the fast ones
+ * until it is that far behind.
+ */
+class FanOut {
+private:
+    struct Consumer {
+        int fd;            // write end of its pipe, -1 once closed
+        std::string spill; // bytes it still has to get, in order
+        size_t sent;       // of the current chunk
+        pid_t pid;
+    };
+    SmallShell &shell;
+    int source;        // read end of the producer's pipe, -1 once closed
+    bool source_watched;
+    int devnull;
+    std::vector<Consumer> consumers;
+    std::vector<char> chunk;
+
+    void pump(short revents);
+    void flush(Consumer &consumer);
+    void closeConsumer(Consumer &consumer);
+    void closeSource();
+    void updateWatches();
+    bool done() const;
+public:
+    explicit FanOut(SmallShell &shell);
+    FanOut(FanOut const &) = delete;
+    void operator=(FanOut const &) = delete;
+    ~FanOut();
+
+    static bool matches(const std::string &cmd_line);
+    // false if cmd_line is not a well formed fan-out
+    static bool parse(const std::string &cmd_line, std::string &producer, std::vector<std::string> &consumers);
+
+    // runs to completion in the foreground, returns the last consumer's status
+    int run(const std::string &producer, const std::vector<std::string> &consumers);
+};
+
+#endif //SMASH_FAN_OUT_H_
@@ -0,0 +1,164 @@
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include "JobGraph.h"
+#include "Commands.h"
+
+std::string PendingJob::waitingFor() const
+{
+    std::string ids;
+    for (const Dependency &dependency : dependencies)
+    {
+        if (not dependency.done)
+        {
+            ids += " %" + std::to_string(dependency.id);
+        }
+    }
+    return ids;
+}
+
+void JobGraph::add(const std::shared_ptr<PendingJob> &job)
+{
+    for (const PendingJob::Dependency &dependency : job->dependencies)
+    {
+        if (dependency.pid > 0)
+        {
+            watch(dependency.pid);
+        }
+    }
+}
+
+void JobGraph::watch(pid_t pid)
+{
+#ifdef SYS_pidfd_open
+    // without it, or if the job is gone already, the next reap at the prompt notices instead
+    int pidfd = syscall(SYS_pidfd_open, pid, 0);
+    if (pidfd == -1)
+    {
+        return;
+    }
+    shell.getEventLoop().add(pidfd, POLLIN, [this](int fd, short) {
+        shell.getEventLoop().remove(fd);
+        close(fd);
+        shell.removeFinishedJobs(); // reaps it and comes back to update()
+    }, true);
+#endif
+}
+
+void JobGraph::update()
+{
+    if (updating)
+    {
+        again = true;
+        return;
+    }
+    updating = true;
+    JobsList &jobs = shell.getJobs();
+    do
+    {
+        again = false;
+        std::vector<std::pair<pid_t, int>> exited;
+        exited.swap(jobs.exited);
+        for (size_t id = 0; id < jobs.jobs.size(); id++)
+        {
+            std::shared_ptr<PendingJob> job = jobs.jobs[id] ? jobs.jobs[id]->get_pending() : nullptr;
+            if (not job || job->state != PendingJob::WAITING)
+            {
+                continue;
+            }
+            resolve(*job, exited);
+            bool all_ok = true;
+            bool any_done = false;
+            int failed = -1;
+            for (const PendingJob::Dependency &dependency : job->dependencies)
+            {
+                all_ok = all_ok && dependency.done && dependency.ok;
+                any_done = any_done || dependency.done;
+                if (dependency.done && not dependency.ok && failed == -1)
+                {
+                    failed = dependency.id;
+                }
+            }
+            if (job->any ? any_done : all_ok)
+            {
+                start(id, job);
+            }
+            else if (not job->any && failed != -1)
+            {
+                drop(id, job, "%" + std::to_string(failed) + " did not succeed");
+            }
+        }
+        // a job started or dropped above may be what a job before it in the list waits for
+    } while (again);
+    updating = false;
+}
+
+void JobGraph::resolve(PendingJob &job, const std::vector<std::pair<pid_t, int>> &exited)
+{
+    const JobsList &jobs = shell.getJobs();
+    for (PendingJob::Dependency &dependency : job.dependencies)
+    {
+        if (dependency.done)
+        {
+            continue;
+        }
+        if (dependency.upstream && dependency.pid == 0)
+        {
+            switch (dependency.upstream->state)
+            {
+                case PendingJob::WAITING:
+                    continue;
+                case PendingJob::RUNNING:
+                    dependency.pid = dependency.upstream->pid;
+                    watch(dependency.pid);
+                    break;
+                case PendingJob::FINISHED:
+                    dependency.done = dependency.ok = true;
+                    continue;
+                case PendingJob::DROPPED:
+                    dependency.done = true;
+                    continue;
+            }
+        }
+        for (const std::pair<pid_t, int> &exit : exited)
+        {
+            if (exit.first == dependency.pid)
+            {
+                dependency.done = true;
+                dependency.ok = WIFEXITED(exit.second) && WEXITSTATUS(exit.second) == 0;
+            }
+        }
+        if (not dependency.done && jobs.getJobByPid(dependency.pid) == nullptr)
+        {
+            dependency.done = true; // gone without a status we saw, count it as failed
+        }
+    }
+}
+
+void JobGraph::start(int id, const std::shared_ptr<PendingJob> &job)
+{
+    again = true;
+    shell.getJobs().removeJobById(id);
+    int status = 0;
+    pid_t pid = shell.startBackground(job->line, id, &status);
+    job->pid = pid;
+    if (pid > 0)
+    {
+        job->state = PendingJob::RUNNING;
+    }
+    else
+    {
+        // a builtin is done already, whether it succeeded is in its $?
+        job->state = pid == 0 && status == 0 ? PendingJob::FINISHED : PendingJob::DROPPED;
+    }
+}
+
+void JobGraph::drop(int id, const std::shared_ptr<PendingJob> &job, const std::string &reason)
+{
+    again = true;
+    JobsList &jobs = shell.getJobs();
+    jobs.reports.push_back("[" + std::to_string(id) + "] " + jobs.getJobById(id)->get_command_name() +
+                           "not started, " + reason);
+    jobs.removeJobById(id);
+    job->state = PendingJob::DROPPED;
+}
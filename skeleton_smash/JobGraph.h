@@ -0,0 +1,68 @@
+#ifndef SMASH_JOB_GRAPH_H_
+#define SMASH_JOB_GRAPH_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+class SmallShell;
+
+// one after command, owned by its entry in the jobs list while it waits and by its dependents after
+struct PendingJob {
+    enum State {
+        WAITING,
+        RUNNING,  // started, pid is its job
+        FINISHED, // a builtin that ran inside smash and succeeded
+        DROPPED   // will not succeed: a dependency failed, it was killed, it could not start, or it was a builtin that failed
+    };
+    struct Dependency {
+        int id;                              // as given, for jobs and the reports
+        pid_t pid;                           // 0 until known, an upstream pending job has none yet
+        std::shared_ptr<PendingJob> upstream; // when the dependency is itself pending
+        bool done;
+        bool ok;                             // exited with status 0
+    };
+    std::string line; // a background command line, started as is
+    bool any;         // start once any dependency is done, rather than once all of them succeeded
+    std::vector<Dependency> dependencies;
+    State state;
+    pid_t pid;
+
+    PendingJob(const std::string &line, bool any) : line(line), any(any), state(WAITING), pid(0) {}
+
+    // " %1 %3", the dependencies still waited for
+    std::string waitingFor() const;
+};
+
+/**
+ * Starts the pending jobs of the after builtin once their dependencies allow.
+ * Dependencies are followed by pid, the ids only name them: a job id may be
+ * reused by the time a dependency ends. Every reaped job's status is handed
+ * to update(), which runs after each reap; a pidfd per dependency makes the
+ * reap happen the moment it exits, from the event loop, so independent
+ * branches of a pipeline start as soon as their own inputs are ready.
+ * A pending job that is started keeps its job id.
+ */
+class JobGraph {
+private:
+    SmallShell &shell;
+    bool updating;
+    bool again; // update() was called from inside itself
+
+    void resolve(PendingJob &job, const std::vector<std::pair<pid_t, int>> &exited);
+    void start(int id, const std::shared_ptr<PendingJob> &job);
+    void drop(int id, const std::shared_ptr<PendingJob> &job, const std::string &reason);
+    void watch(pid_t pid);
+public:
+    explicit JobGraph(SmallShell &shell) : shell(shell), updating(false), again(false) {}
+    JobGraph(JobGraph const &) = delete;
+    void operator=(JobGraph const &) = delete;
+
+    // registers the job's dependencies with the event loop, it must already be in the jobs list
+    void add(const std::shared_ptr<PendingJob> &job);
+    // takes the statuses the jobs list collected and starts or drops whatever that decides
+    void update();
+};
+
+#endif //SMASH_JOB_GRAPH_H_
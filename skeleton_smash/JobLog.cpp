@@ -0,0 +1,95 @@
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <algorithm>
+#include "JobLog.h"
+#include "Trace.h"
+
+JobLog::JobLog(EventLoop &events, int fd, size_t size) : events(events), fd(fd), ring(size), written(0)
+{
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    // drained during foreground waits too, a job must never block on a full pipe
+    events.add(fd, POLLIN, [this](int, short) { drain(); }, true);
+}
+
+JobLog::~JobLog()
+{
+    close();
+}
+
+void JobLog::close()
+{
+    if (fd != -1)
+    {
+        events.remove(fd);
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+void JobLog::drain()
+{
+    TraceSpan span("drain");
+    char buf[JOB_LOG_READ_CHUNK];
+    while (true)
+    {
+        ssize_t n = ::read(fd, buf, sizeof(buf));
+        if (n > 0)
+        {
+            // only the tail of a chunk larger than the ring survives anyway
+            size_t skip = (size_t)n > ring.size() ? n - ring.size() : 0;
+            for (size_t i = skip; i < (size_t)n; )
+            {
+                size_t at = (written + i) % ring.size();
+                size_t length = std::min((size_t)n - i, ring.size() - at);
+                std::copy(buf + i, buf + i + length, ring.begin() + at);
+                i += length;
+            }
+            written += n;
+        }
+        else if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        else
+        {
+            if (n == 0 || errno != EAGAIN)
+            {
+                close(); // every writer is gone
+            }
+            return;
+        }
+    }
+}
+
+unsigned long long JobLog::getStart() const
+{
+    return written > ring.size() ? written - ring.size() : 0;
+}
+
+void JobLog::shrink()
+{
+    size_t held = written - getStart();
+    if (fd != -1 || held == ring.size())
+    {
+        return;
+    }
+    // every offset keeps its place modulo the new size, read() needs nothing else
+    std::vector<char> kept(held);
+    for (unsigned long long offset = getStart(); offset < written; offset++)
+    {
+        kept[offset % held] = ring[offset % ring.size()];
+    }
+    ring.swap(kept);
+}
+
+void JobLog::read(unsigned long long from, std::string &out) const
+{
+    for (unsigned long long offset = std::max(from, getStart()); offset < written; )
+    {
+        size_t at = offset % ring.size();
+        size_t length = std::min((size_t)(written - offset), ring.size() - at);
+        out.append(ring.data() + at, length);
+        offset += length;
+    }
+}
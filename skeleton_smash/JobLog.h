@@ -0,0 +1,46 @@
+#ifndef SMASH_JOB_LOG_H_
+#define SMASH_JOB_LOG_H_
+
+#include <string>
+#include <vector>
+#include "EventLoop.h"
+
+#define JOB_LOG_DEFAULT_SIZE (64 * 1024)
+#define JOB_LOG_READ_CHUNK (16 * 1024)
+#define JOB_LOG_FINISHED_KEEP 4 // logs of ended jobs joblog can still show, the oldest goes first
+
+/**
+ * The captured stdout/stderr of one background job (capture builtin). The job
+ * writes into a pipe that the event loop drains into a fixed size ring buffer,
+ * so a job never waits on the terminal or on smash; once the ring is full the
+ * oldest output is overwritten. Positions are offsets into everything the job
+ * ever wrote, which lets joblog -f continue where it stopped.
+ */
+class JobLog {
+private:
+    EventLoop &events;
+    int fd;                    // read end of the pipe, -1 after EOF
+    std::vector<char> ring;
+    unsigned long long written; // bytes received so far
+
+    void drain();
+    void close();
+public:
+    // takes ownership of fd and registers it with the event loop
+    JobLog(EventLoop &events, int fd, size_t size);
+    JobLog(JobLog const &) = delete;
+    void operator=(JobLog const &) = delete;
+    ~JobLog();
+
+    bool isOpen() const { return fd != -1; }
+    unsigned long long getWritten() const { return written; }
+    // oldest offset still in the ring
+    unsigned long long getStart() const;
+
+    // appends the bytes from offset from (clamped to getStart()) up to getWritten()
+    void read(unsigned long long from, std::string &out) const;
+    // once closed, gives back the part of the ring the job never filled
+    void shrink();
+};
+
+#endif //SMASH_JOB_LOG_H_
@@ -0,0 +1,175 @@
+#include <sched.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <algorithm>
+#include <sstream>
+#include "JobPlacer.h"
+
+static const std::pair<const char*, PlacementPolicy> POLICIES[] = {
+    {"off", PLACEMENT_OFF},
+    {"rr", PLACEMENT_ROUND_ROBIN},
+    {"least-loaded", PLACEMENT_LEAST_LOADED},
+};
+
+JobPlacer::JobPlacer() : policy(PLACEMENT_OFF), next(0)
+{
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0)
+    {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+        {
+            if (CPU_ISSET(cpu, &allowed))
+            {
+                pool.push_back(cpu);
+            }
+        }
+    }
+}
+
+bool JobPlacer::setPool(const std::vector<int> &cpus)
+{
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == -1)
+    {
+        return false;
+    }
+    for (int cpu : cpus)
+    {
+        if (not CPU_ISSET(cpu, &allowed))
+        {
+            return false;
+        }
+    }
+    pool = cpus;
+    next = 0;
+    return true;
+}
+
+bool JobPlacer::allows(const std::vector<int> &cpus) const
+{
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == -1)
+    {
+        return false;
+    }
+    for (int cpu : cpus)
+    {
+        if (not CPU_ISSET(cpu, &allowed) || std::find(pool.begin(), pool.end(), cpu) == pool.end())
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+int JobPlacer::place(const std::vector<unsigned int> &loads)
+{
+    if (policy == PLACEMENT_OFF || pool.empty())
+    {
+        return -1;
+    }
+    if (policy == PLACEMENT_ROUND_ROBIN)
+    {
+        return pool[next++ % pool.size()];
+    }
+    // least loaded, ties go round robin so an idle pool still fills evenly
+    size_t best = next % pool.size();
+    for (size_t i = 0; i < pool.size(); i++)
+    {
+        size_t candidate = (next + i) % pool.size();
+        if (loads[pool[candidate]] < loads[pool[best]])
+        {
+            best = candidate;
+        }
+    }
+    next = best + 1;
+    return pool[best];
+}
+
+bool JobPlacer::parseCpuList(const std::string &text, std::vector<int> &cpus)
+{
+    std::vector<int> parsed;
+    std::istringstream ranges(text);
+    for (std::string range; std::getline(ranges, range, ','); )
+    {
+        char *end;
+        if (range.empty() || not isdigit(range[0]))
+        {
+            return false;
+        }
+        long first = strtol(range.c_str(), &end, 10);
+        long last = first;
+        if (*end == '-')
+        {
+            if (not isdigit(end[1]))
+            {
+                return false;
+            }
+            last = strtol(end + 1, &end, 10);
+        }
+        if (*end || last < first || last >= CPU_SETSIZE)
+        {
+            return false;
+        }
+        for (long cpu = first; cpu <= last; cpu++)
+        {
+            parsed.push_back(cpu);
+        }
+    }
+    if (parsed.empty())
+    {
+        return false;
+    }
+    std::sort(parsed.begin(), parsed.end());
+    parsed.erase(std::unique(parsed.begin(), parsed.end()), parsed.end());
+    cpus = parsed;
+    return true;
+}
+
+std::string JobPlacer::formatCpuList(const std::vector<int> &cpus)
+{
+    std::string text;
+    for (size_t i = 0; i < cpus.size(); )
+    {
+        size_t j = i;
+        while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1)
+        {
+            j++;
+        }
+        text += (text.empty() ? "" : ",") + std::to_string(cpus[i]);
+        if (j > i)
+        {
+            text += "-" + std::to_string(cpus[j]);
+        }
+        i = j + 1;
+    }
+    return text;
+}
+
+bool JobPlacer::parsePolicy(const std::string &name, PlacementPolicy &policy)
+{
+    for (const auto &known : POLICIES)
+    {
+        if (name == known.first)
+        {
+            policy = known.second;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char *JobPlacer::policyName(PlacementPolicy policy)
+{
+    for (const auto &known : POLICIES)
+    {
+        if (policy == known.second)
+        {
+            return known.first;
+        }
+    }
+    return "off";
+}
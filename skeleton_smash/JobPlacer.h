@@ -0,0 +1,47 @@
+#ifndef SMASH_JOB_PLACER_H_
+#define SMASH_JOB_PLACER_H_
+
+#include <string>
+#include <vector>
+
+enum PlacementPolicy {
+    PLACEMENT_OFF = 0,       // jobs inherit smash's affinity
+    PLACEMENT_ROUND_ROBIN,
+    PLACEMENT_LEAST_LOADED
+};
+
+/**
+ * Picks the CPU a background job is pinned to (sched builtin). The choice is
+ * made in the shell and applied with sched_setaffinity in the child, so a
+ * batch of jobs started with & is spread over the pool instead of landing
+ * wherever the scheduler first puts them.
+ */
+class JobPlacer {
+private:
+    PlacementPolicy policy;
+    std::vector<int> pool; // CPUs jobs may be placed on
+    size_t next;           // round robin cursor into pool
+public:
+    JobPlacer(); // off, the pool is every CPU smash may run on
+
+    PlacementPolicy getPolicy() const { return policy; }
+    void setPolicy(PlacementPolicy policy) { this->policy = policy; }
+    const std::vector<int> &getPool() const { return pool; }
+    // false, and the pool unchanged, if smash may not run on one of the CPUs
+    bool setPool(const std::vector<int> &cpus);
+    // whether a job may be pinned to all of cpus ("cmd &@2-3"): they are in the pool and smash may still run there
+    bool allows(const std::vector<int> &cpus) const;
+
+    // CPU for the next background job, -1 when placement is off.
+    // loads has CPU_SETSIZE entries, the number of running jobs pinned to each CPU.
+    int place(const std::vector<unsigned int> &loads);
+
+    // "0-3,6" <-> {0,1,2,3,6}
+    static bool parseCpuList(const std::string &text, std::vector<int> &cpus);
+    static std::string formatCpuList(const std::vector<int> &cpus);
+
+    static bool parsePolicy(const std::string &name, PlacementPolicy &policy);
+    static const char *policyName(PlacementPolicy policy);
+};
+
+#endif //SMASH_JOB_PLACER_H_
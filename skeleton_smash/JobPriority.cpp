@@ -0,0 +1,116 @@
+#include <unistd.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <linux/capability.h>
+#include <algorithm>
+#include "JobPriority.h"
+
+#define IOPRIO_WHO_PROCESS 1
+#define IOPRIO_WHO_PGRP 2
+#define IOPRIO_CLASS_SHIFT 13
+
+static int _ioprioSet(int which, int who, int io_class, int io_level)
+{
+    // glibc has no wrapper for ioprio_set
+    return syscall(SYS_ioprio_set, which, who, (io_class << IOPRIO_CLASS_SHIFT) | io_level);
+}
+
+// whether this process may set a nice level below the one it has, down to nice
+static bool _canLowerNice(int nice)
+{
+    // glibc has no wrapper for capget either
+    struct __user_cap_header_struct header = {_LINUX_CAPABILITY_VERSION_3, 0};
+    struct __user_cap_data_struct data[_LINUX_CAPABILITY_U32S_3];
+    if (syscall(SYS_capget, &header, data) == 0 &&
+        (data[CAP_TO_INDEX(CAP_SYS_NICE)].effective & CAP_TO_MASK(CAP_SYS_NICE)))
+    {
+        return true;
+    }
+    // RLIMIT_NICE is 20 - the lowest nice level allowed
+    struct rlimit limit;
+    return getrlimit(RLIMIT_NICE, &limit) == 0 &&
+           (limit.rlim_cur == RLIM_INFINITY || 20 - (long)limit.rlim_cur <= nice);
+}
+
+JobPriority::JobPriority() : enabled(true), nice(BACKGROUND_NICE_DEFAULT), io_class(SMASH_IOPRIO_CLASS_BE),
+                             io_level(BACKGROUND_IO_LEVEL_DEFAULT), own_nice(0), own_ioprio(0), can_renice(false)
+{
+    // -1 is a valid nice level, only errno tells it from a failure
+    errno = 0;
+    int current = getpriority(PRIO_PROCESS, 0);
+    if (errno == 0)
+    {
+        own_nice = current;
+    }
+    current = syscall(SYS_ioprio_get, IOPRIO_WHO_PROCESS, 0);
+    if (current != -1)
+    {
+        own_ioprio = current;
+    }
+    can_renice = _canLowerNice(own_nice);
+}
+
+bool JobPriority::parseIoClass(const std::string &text, int &io_class, int &io_level)
+{
+    if (text == "idle")
+    {
+        io_class = SMASH_IOPRIO_CLASS_IDLE;
+        io_level = 0;
+        return true;
+    }
+    std::string prefix = "best-effort";
+    if (text.compare(0, prefix.size(), prefix) != 0)
+    {
+        return false;
+    }
+    if (text.size() == prefix.size())
+    {
+        io_class = SMASH_IOPRIO_CLASS_BE;
+        io_level = BACKGROUND_IO_LEVEL_DEFAULT;
+        return true;
+    }
+    if (text.size() != prefix.size() + 2 || text[prefix.size()] != ':' ||
+        text.back() < '0' || text.back() > '7')
+    {
+        return false;
+    }
+    io_class = SMASH_IOPRIO_CLASS_BE;
+    io_level = text.back() - '0';
+    return true;
+}
+
+std::string JobPriority::ioClassName() const
+{
+    if (io_class == SMASH_IOPRIO_CLASS_IDLE)
+    {
+        return "idle";
+    }
+    return "best-effort:" + std::to_string(io_level);
+}
+
+bool JobPriority::demote(pid_t pgid) const
+{
+    if (can_renice && setpriority(PRIO_PGRP, pgid, std::min(own_nice + nice, 19)) == -1)
+    {
+        return false;
+    }
+    return _ioprioSet(IOPRIO_WHO_PGRP, pgid, io_class, io_level) == 0;
+}
+
+bool JobPriority::promote(pid_t pgid) const
+{
+    // try both, errno is the first failure
+    int error = 0;
+    if (can_renice && setpriority(PRIO_PGRP, pgid, own_nice) == -1)
+    {
+        error = errno;
+    }
+    if (syscall(SYS_ioprio_set, IOPRIO_WHO_PGRP, pgid, own_ioprio) == -1 && error == 0)
+    {
+        error = errno;
+    }
+    errno = error;
+    return error == 0;
+}
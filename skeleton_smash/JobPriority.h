@@ -0,0 +1,57 @@
+#ifndef SMASH_JOB_PRIORITY_H_
+#define SMASH_JOB_PRIORITY_H_
+
+#include <string>
+#include <sys/types.h>
+
+// ioprio classes, the kernel's uapi header is not always installed
+#define SMASH_IOPRIO_CLASS_NONE 0 // follow the CPU nice level, the default
+#define SMASH_IOPRIO_CLASS_BE 2
+#define SMASH_IOPRIO_CLASS_IDLE 3
+
+#define BACKGROUND_NICE_DEFAULT 10
+#define BACKGROUND_IO_LEVEL_DEFAULT 7 // lowest best-effort level
+
+/**
+ * Lower CPU and IO priority for background jobs (bgprio builtin, on by
+ * default), so the commands run from the prompt stay responsive however many
+ * & jobs there are. smash demotes a job's process group right after fork, and
+ * promotes it back to smash's own priority, as it was when smash started, when
+ * fg brings it to the foreground.
+ * Promoting lowers a nice value, which needs CAP_SYS_NICE or an RLIMIT_NICE
+ * that allows it. A smash that can't do that only lowers the IO priority,
+ * which a user can always raise again for their own processes, and bgprio
+ * says the nice level is not applied.
+ */
+class JobPriority {
+private:
+    bool enabled;
+    int nice;     // added to smash's own nice level, like nice(1)
+    int io_class;
+    int io_level;
+    int own_nice;   // smash's, what fg restores
+    int own_ioprio; // smash's, as ioprio_get returns it
+    bool can_renice; // smash may lower a nice level back to own_nice, otherwise jobs keep theirs
+public:
+    JobPriority();
+
+    bool isEnabled() const { return enabled; }
+    void setEnabled(bool enabled) { this->enabled = enabled; }
+    int getNice() const { return nice; }
+    void setNice(int nice) { this->nice = nice; }
+    void setIoClass(int io_class, int io_level) { this->io_class = io_class; this->io_level = io_level; }
+    // false when fg could not undo the nice level, and jobs are only given the lower IO priority
+    bool appliesNice() const { return can_renice; }
+
+    // "idle", "best-effort" or "best-effort:N" (N is 0 to 7) <-> class and level
+    static bool parseIoClass(const std::string &text, int &io_class, int &io_level);
+    std::string ioClassName() const;
+
+    // the job's process group to background priority, false with errno set if a priority could not be applied
+    bool demote(pid_t pgid) const;
+    // the job's process group back to smash's own priority. false with errno set if
+    // something could not be restored
+    bool promote(pid_t pgid) const;
+};
+
+#endif //SMASH_JOB_PRIORITY_H_
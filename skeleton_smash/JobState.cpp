@@ -0,0 +1,144 @@
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fstream>
+#include <sstream>
+#include "JobState.h"
+
+static void _copyField(char *field, size_t size, const std::string &text)
+{
+    strncpy(field, text.c_str(), size - 1);
+    field[size - 1] = '\0';
+}
+
+JobStateTable::~JobStateTable()
+{
+    if (map)
+    {
+        munmap(map, map_size);
+    }
+    if (fd != -1)
+    {
+        close(fd); // drops the lock
+    }
+}
+
+bool JobStateTable::open(const std::string &path, uint32_t records)
+{
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd == -1)
+    {
+        perror("smash error: open failed");
+        return false;
+    }
+    if (flock(fd, LOCK_EX | LOCK_NB) == -1)
+    {
+        fprintf(stderr, "smash error: state file %s is used by another smash\n", path.c_str());
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1)
+    {
+        perror("smash error: fstat failed");
+        return false;
+    }
+    map_size = sizeof(Header) + (size_t)records * sizeof(JobStateRecord);
+    bool fresh = st.st_size == 0;
+    if (not fresh && (size_t)st.st_size != map_size)
+    {
+        fprintf(stderr, "smash error: state file %s was written by a different smash\n", path.c_str());
+        return false;
+    }
+    if (fresh && ftruncate(fd, map_size) == -1)
+    {
+        perror("smash error: ftruncate failed");
+        return false;
+    }
+    map = mmap(nullptr, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED)
+    {
+        map = nullptr;
+        perror("smash error: mmap failed");
+        return false;
+    }
+    header = static_cast<Header*>(map);
+    if (fresh)
+    {
+        // ftruncate zero filled it, every record starts out free
+        header->record_size = sizeof(JobStateRecord);
+        header->records = records;
+        memcpy(header->magic, JOB_STATE_MAGIC, sizeof(header->magic));
+    }
+    else if (memcmp(header->magic, JOB_STATE_MAGIC, sizeof(header->magic)) != 0 ||
+             header->record_size != sizeof(JobStateRecord) || header->records != records)
+    {
+        fprintf(stderr, "smash error: state file %s was written by a different smash\n", path.c_str());
+        return false;
+    }
+    this->records = reinterpret_cast<JobStateRecord*>(header + 1);
+    count = records;
+    return true;
+}
+
+void JobStateTable::store(int id, pid_t pid, uint64_t start_ticks, bool demoted, const std::string &cpus,
+                          const std::string &limits, const std::string &cmd)
+{
+    if (not records || id < 0 || (uint32_t)id >= count)
+    {
+        return;
+    }
+    JobStateRecord &record = records[id];
+    record.pid = 0;
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+    record.demoted = demoted;
+    record.start_ticks = start_ticks;
+    record.started = time(nullptr);
+    _copyField(record.cpus, sizeof(record.cpus), cpus);
+    _copyField(record.limits, sizeof(record.limits), limits);
+    _copyField(record.cmd, sizeof(record.cmd), cmd);
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+    record.pid = pid;
+}
+
+void JobStateTable::erase(int id)
+{
+    if (records && id >= 0 && (uint32_t)id < count)
+    {
+        records[id].pid = 0;
+    }
+}
+
+bool JobStateTable::startTime(pid_t pid, uint64_t &ticks)
+{
+    std::ifstream stat(("/proc/" + std::to_string(pid) + "/stat").c_str());
+    std::string line;
+    if (not std::getline(stat, line))
+    {
+        return false;
+    }
+    // the command name in parentheses may hold spaces and parentheses of its own
+    size_t end = line.rfind(')');
+    if (end == std::string::npos)
+    {
+        return false;
+    }
+    std::istringstream fields(line.substr(end + 1));
+    std::string state;
+    fields >> state; // field 3
+    if (state == "Z" || state == "X")
+    {
+        return false;
+    }
+    std::string skip;
+    for (int field = 4; field < 22; field++)
+    {
+        fields >> skip;
+    }
+    return static_cast<bool>(fields >> ticks);
+}
@@ -0,0 +1,72 @@
+#ifndef SMASH_JOB_STATE_H_
+#define SMASH_JOB_STATE_H_
+
+#include <stdint.h>
+#include <string>
+#include <sys/types.h>
+
+#define JOB_STATE_MAGIC "smashjb1"
+#define JOB_STATE_CMD_SIZE 256
+#define JOB_STATE_CPUS_SIZE 64
+#define JOB_STATE_LIMITS_SIZE 128
+
+// one job, at the index of its job id
+struct JobStateRecord {
+    int32_t pid;          // 0 for a free slot. written last, so a half written record reads as free
+    int32_t demoted;
+    uint64_t start_ticks; // starttime from /proc/pid/stat, tells the job from a later process with its pid
+    int64_t started;      // wall clock, seconds
+    char cpus[JOB_STATE_CPUS_SIZE];     // as JobPlacer formats them, "" if not placed
+    char limits[JOB_STATE_LIMITS_SIZE]; // the limit prefix specs, space separated
+    char cmd[JOB_STATE_CMD_SIZE];
+};
+
+/**
+ * The jobs list kept in a file (smash --state=FILE), so a smash that is
+ * restarted, for an upgrade or after a crash, adopts the background jobs the
+ * previous one left running instead of losing track of them.
+ *
+ * The file is a fixed array of records mapped MAP_SHARED, each add or delete
+ * is a store into the mapping and costs no system call; the page cache keeps
+ * it when smash dies. A record is only trusted while its pid still has the
+ * start time it was written with, so a pid reused by an unrelated process is
+ * never adopted. The file is locked while a smash uses it.
+ *
+ * What the job was started with (limits, CPUs, priority) is recorded, what it
+ * has used is not: that only exists in /proc while it runs and in wait4 once
+ * reaped, when its record goes away.
+ */
+class JobStateTable {
+private:
+    struct Header {
+        char magic[8];
+        uint32_t record_size;
+        uint32_t records;
+    };
+    int fd;
+    void *map;
+    size_t map_size;
+    Header *header;
+    JobStateRecord *records;
+    uint32_t count;
+public:
+    JobStateTable() : fd(-1), map(nullptr), map_size(0), header(nullptr), records(nullptr), count(0) {}
+    JobStateTable(JobStateTable const &) = delete;
+    void operator=(JobStateTable const &) = delete;
+    ~JobStateTable();
+
+    // creates the file if needed. false, after printing why, if it can't be used
+    bool open(const std::string &path, uint32_t records);
+    bool isOpen() const { return records != nullptr; }
+    uint32_t size() const { return count; }
+    const JobStateRecord &get(int id) const { return records[id]; }
+
+    void store(int id, pid_t pid, uint64_t start_ticks, bool demoted, const std::string &cpus,
+               const std::string &limits, const std::string &cmd);
+    void erase(int id);
+
+    // false if pid is gone or a zombie
+    static bool startTime(pid_t pid, uint64_t &ticks);
+};
+
+#endif //SMASH_JOB_STATE_H_
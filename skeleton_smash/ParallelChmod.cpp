@@ -0,0 +1,218 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <thread>
+#include "ParallelChmod.h"
+
+// the record layout getdents64 fills in, glibc does not export it
+struct linux_dirent64 {
+    ino64_t d_ino;
+    off64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+ParallelChmod::OpenDir::~OpenDir()
+{
+    close(fd);
+}
+
+ParallelChmod::ParallelChmod(mode_t mode, unsigned int threads)
+        : mode(mode), queued(0), pending(0), changed(0), failed(0)
+{
+    for (unsigned int i = 0; i < (threads ? threads : 1); i++)
+    {
+        queues.push_back(std::unique_ptr<WorkQueue>(new WorkQueue()));
+    }
+}
+
+void ParallelChmod::push(size_t self, QueuedDir dir)
+{
+    std::lock_guard<std::mutex> guard(queues[self]->lock);
+    queues[self]->dirs.push_back(std::move(dir));
+    // counted before the queue is unlocked, so no thief can finish it first
+    std::lock_guard<std::mutex> idle_guard(idle_lock);
+    queued++;
+    pending++;
+    idle.notify_one();
+}
+
+bool ParallelChmod::pop(size_t self, QueuedDir &dir)
+{
+    bool found = false;
+    {
+        // own work, newest first: keeps the walk depth first and the deque short
+        std::lock_guard<std::mutex> guard(queues[self]->lock);
+        if (not queues[self]->dirs.empty())
+        {
+            dir = std::move(queues[self]->dirs.back());
+            queues[self]->dirs.pop_back();
+            found = true;
+        }
+    }
+    for (size_t i = 1; i < queues.size() && not found; i++)
+    {
+        // steal the oldest entry, the one most likely to have a big subtree under it
+        WorkQueue &victim = *queues[(self + i) % queues.size()];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (not victim.dirs.empty())
+        {
+            dir = std::move(victim.dirs.front());
+            victim.dirs.pop_front();
+            found = true;
+        }
+    }
+    if (found)
+    {
+        std::lock_guard<std::mutex> guard(idle_lock);
+        queued--;
+    }
+    return found;
+}
+
+void ParallelChmod::finish()
+{
+    std::lock_guard<std::mutex> guard(idle_lock);
+    if (--pending == 0)
+    {
+        idle.notify_all(); // the walk is over, wake everyone to leave
+    }
+}
+
+void ParallelChmod::worker(size_t self)
+{
+    QueuedDir dir;
+    while (true)
+    {
+        if (pop(self, dir))
+        {
+            processDir(self, dir);
+            dir.parent.reset(); // the parent closes once its last subdirectory was listed
+            finish();
+            continue;
+        }
+        // others are still listing directories that may produce work
+        std::unique_lock<std::mutex> guard(idle_lock);
+        idle.wait(guard, [this] { return queued > 0 || pending == 0; });
+        if (pending == 0)
+        {
+            return;
+        }
+    }
+}
+
+void ParallelChmod::processDir(size_t self, const QueuedDir &dir)
+{
+    int fd;
+    if (dir.parent)
+    {
+        // O_NOFOLLOW: it was a directory when its parent was listed, a link put in its place is not entered
+        fd = openat(dir.parent->fd, dir.name.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (fd < 0 && errno == EACCES &&
+            fchmodat(dir.parent->fd, dir.name.c_str(), mode, AT_SYMLINK_NOFOLLOW) == 0)
+        {
+            // the mode being set may be what lets us read it
+            fd = openat(dir.parent->fd, dir.name.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        }
+        if (fd < 0)
+        {
+            if (errno != ELOOP && errno != ENOTDIR) failed++;
+            return;
+        }
+        if (fchmod(fd, mode) == 0)
+        {
+            changed++;
+        }
+        else
+        {
+            failed++;
+        }
+    }
+    else
+    {
+        // a root was changed by run(), and is followed if it is a link, like chmod itself does
+        fd = open(dir.name.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            failed++;
+            return;
+        }
+    }
+    std::shared_ptr<OpenDir> open_dir = std::make_shared<OpenDir>(fd);
+    char buf[GETDENTS_BUFFER_SIZE];
+    while (true)
+    {
+        long n = syscall(SYS_getdents64, fd, buf, sizeof(buf));
+        if (n <= 0)
+        {
+            if (n < 0) failed++;
+            break;
+        }
+        for (long offset = 0; offset < n; )
+        {
+            struct linux_dirent64 *entry = (struct linux_dirent64 *)(buf + offset);
+            offset += entry->d_reclen;
+            const char *name = entry->d_name;
+            if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) continue;
+
+            unsigned char type = entry->d_type;
+            if (type == DT_UNKNOWN)
+            {
+                struct stat st;
+                if (fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) < 0)
+                {
+                    failed++;
+                    continue;
+                }
+                type = S_ISDIR(st.st_mode) ? DT_DIR : (S_ISLNK(st.st_mode) ? DT_LNK : DT_REG);
+            }
+            if (type == DT_LNK) continue;
+            if (type == DT_DIR)
+            {
+                push(self, QueuedDir{open_dir, name}); // changed through its own descriptor when it is listed
+                continue;
+            }
+            if (fchmodat(fd, name, mode, AT_SYMLINK_NOFOLLOW) == 0)
+            {
+                changed++;
+            }
+            else if (errno != EOPNOTSUPP)
+            {
+                failed++; // EOPNOTSUPP: it has turned into a symbolic link, which is left alone
+            }
+        }
+    }
+}
+
+void ParallelChmod::run(const std::vector<std::string> &roots)
+{
+    for (const std::string &root : roots)
+    {
+        struct stat st;
+        if (chmod(root.c_str(), mode) < 0 || stat(root.c_str(), &st) < 0)
+        {
+            failed++;
+            continue;
+        }
+        changed++;
+        if (S_ISDIR(st.st_mode))
+        {
+            push(0, QueuedDir{nullptr, root});
+        }
+    }
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < queues.size(); i++)
+    {
+        threads.push_back(std::thread(&ParallelChmod::worker, this, i));
+    }
+    worker(0);
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+}
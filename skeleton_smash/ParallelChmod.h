@@ -0,0 +1,68 @@
+#ifndef SMASH_PARALLEL_CHMOD_H_
+#define SMASH_PARALLEL_CHMOD_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+#define GETDENTS_BUFFER_SIZE (64 * 1024)
+
+/**
+ * chmod -R over a pool of threads. Every worker owns a deque of directories
+ * still to be listed: it pushes and pops its own end and, when it runs dry,
+ * steals from the other end of someone else's, and sleeps while there is
+ * nothing to steal. Directories are read with getdents64, and everything
+ * below a root is reached relative to its open parent (openat, fchmodat), so
+ * no path is walked twice and a directory that is swapped for a symbolic link
+ * meanwhile is not followed. Symbolic links below the roots are neither
+ * followed nor changed.
+ */
+class ParallelChmod {
+private:
+    // a directory that is being listed, open while its subdirectories wait in the queues
+    struct OpenDir {
+        int fd;
+        explicit OpenDir(int fd) : fd(fd) {}
+        OpenDir(OpenDir const &) = delete;
+        void operator=(OpenDir const &) = delete;
+        ~OpenDir();
+    };
+    struct QueuedDir {
+        std::shared_ptr<OpenDir> parent; // null for a root
+        std::string name;                // in parent, or the root's path
+    };
+    struct WorkQueue {
+        std::mutex lock;
+        std::deque<QueuedDir> dirs;
+    };
+    mode_t mode;
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    std::mutex idle_lock;
+    std::condition_variable idle; // a worker with nothing to steal waits here
+    long queued;  // directories in the queues, under idle_lock
+    long pending; // directories queued or being listed, under idle_lock
+    std::atomic<unsigned long> changed;
+    std::atomic<unsigned long> failed;
+
+    void push(size_t self, QueuedDir dir);
+    bool pop(size_t self, QueuedDir &dir);
+    void finish();
+    void worker(size_t self);
+    void processDir(size_t self, const QueuedDir &dir);
+public:
+    ParallelChmod(mode_t mode, unsigned int threads);
+    ParallelChmod(ParallelChmod const &) = delete;
+    void operator=(ParallelChmod const &) = delete;
+
+    void run(const std::vector<std::string> &roots);
+
+    unsigned long getChanged() const { return changed; }
+    unsigned long getFailed() const { return failed; }
+};
+
+#endif //SMASH_PARALLEL_CHMOD_H_
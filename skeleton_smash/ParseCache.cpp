@@ -0,0 +1,72 @@
+#include <functional>
+#include <iterator>
+#include "ParseCache.h"
+
+size_t ParsedCommand::footprint() const
+{
+    size_t bytes = sizeof(ParsedCommand) + cmd_line.capacity() + job_name.capacity() + redirection_path.capacity() + exec_path.capacity();
+    bytes += exec_line.capacity() + limits.capacity() * sizeof(ResourceLimit) + pinned_cpus.capacity() * sizeof(int);
+    bytes += (args.capacity() + assignments.capacity()) * sizeof(std::string);
+    for (const std::string &arg : args)
+    {
+        bytes += arg.capacity();
+    }
+    for (const std::string &assignment : assignments)
+    {
+        bytes += assignment.capacity();
+    }
+    for (const ResourceLimit &limit : limits)
+    {
+        bytes += limit.spec.capacity();
+    }
+    return bytes;
+}
+
+std::shared_ptr<const ParsedCommand> ParseCache::lookup(const std::string &raw)
+{
+    auto found = index.find(std::hash<std::string>()(raw));
+    if (found == index.end() || found->second->raw != raw)
+    {
+        miss_count++;
+        return nullptr;
+    }
+    hit_count++;
+    lru.splice(lru.begin(), lru, found->second);
+    return found->second->parsed;
+}
+
+void ParseCache::insert(const std::string &raw, std::shared_ptr<const ParsedCommand> parsed)
+{
+    size_t hash = std::hash<std::string>()(raw);
+    auto found = index.find(hash);
+    if (found != index.end())
+    {
+        evict(found->second);
+    }
+    size_t bytes = parsed->footprint() + raw.capacity() + sizeof(Entry);
+    if (bytes > budget)
+    {
+        return;
+    }
+    while (used + bytes > budget && not lru.empty())
+    {
+        evict(std::prev(lru.end()));
+    }
+    lru.push_front(Entry{hash, raw, parsed, bytes});
+    index[hash] = lru.begin();
+    used += bytes;
+}
+
+void ParseCache::clear()
+{
+    lru.clear();
+    index.clear();
+    used = 0;
+}
+
+void ParseCache::evict(std::list<Entry>::iterator it)
+{
+    used -= it->bytes;
+    index.erase(it->hash);
+    lru.erase(it);
+}
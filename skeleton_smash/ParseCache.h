@@ -0,0 +1,108 @@
+#ifndef SMASH_PARSE_CACHE_H_
+#define SMASH_PARSE_CACHE_H_
+
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <sys/resource.h>
+
+#define PARSE_CACHE_BUDGET (1 << 20) // bytes
+
+enum BuiltinId {
+    BUILTIN_NONE = 0,
+    BUILTIN_CHPROMPT,
+    BUILTIN_SHOWPID,
+    BUILTIN_PWD,
+    BUILTIN_CD,
+    BUILTIN_JOBS,
+    BUILTIN_FG,
+    BUILTIN_QUIT,
+    BUILTIN_KILL,
+    BUILTIN_CHMOD,
+    BUILTIN_EXPORT,
+    BUILTIN_UNSET,
+    BUILTIN_ENV,
+    BUILTIN_PUSHD,
+    BUILTIN_POPD,
+    BUILTIN_DIRS,
+    BUILTIN_LIMIT,  // only a malformed limit prefix, a valid one wraps an external command
+    BUILTIN_SCHED,
+    BUILTIN_BGPRIO,
+    BUILTIN_CAPTURE,
+    BUILTIN_JOBLOG,
+    BUILTIN_EVERY,
+    BUILTIN_AFTER
+};
+
+// one --name=value option of the limit prefix
+struct ResourceLimit {
+    int resource;    // RLIMIT_*
+    rlim_t value;
+    std::string spec; // as typed, e.g. "as=2G"
+};
+
+/**
+ * The fully parsed form of one command line. Built once per distinct line,
+ * then shared (read only) by the cache and every Command created from it.
+ */
+struct ParsedCommand {
+    std::string cmd_line;           // the line without its redirection
+    std::string job_name;           // cmd_line and a space, as listed by jobs
+    std::vector<std::string> args;  // the words, background sign removed
+    std::vector<std::string> assignments; // leading NAME=value environment overrides
+    BuiltinId builtin;
+    bool background;
+    bool complex;                   // contains wildcards, executed through bash
+    int redirection_type;           // 0, OVERWRITE or APPEND
+    std::string redirection_path;
+    int pipe_type;                  // 0, or the fd the pipe producer writes to
+    std::string exec_path;          // resolved from PATH, empty when not found
+    std::vector<ResourceLimit> limits; // set in the child before exec
+    std::vector<int> pinned_cpus;   // from a "&@0-3" suffix
+    std::string exec_line;          // what bash runs for complex commands: cmd_line minus limit prefix and pin, "" if the same
+
+    ParsedCommand() : builtin(BUILTIN_NONE), background(false), complex(false),
+                      redirection_type(0), pipe_type(0) {}
+
+    // approximate heap + object size, charged against the cache budget
+    size_t footprint() const;
+};
+
+/**
+ * LRU cache of ParsedCommand keyed by a hash of the raw line. The raw line is
+ * kept next to the entry so a hash collision is a miss, never a wrong hit.
+ */
+class ParseCache {
+private:
+    struct Entry {
+        size_t hash;
+        std::string raw;
+        std::shared_ptr<const ParsedCommand> parsed;
+        size_t bytes;
+    };
+    std::list<Entry> lru; // most recently used first
+    std::unordered_map<size_t, std::list<Entry>::iterator> index;
+    size_t budget;
+    size_t used;
+    unsigned long hit_count;
+    unsigned long miss_count;
+
+    void evict(std::list<Entry>::iterator it);
+public:
+    explicit ParseCache(size_t budget = PARSE_CACHE_BUDGET) : budget(budget), used(0), hit_count(0), miss_count(0) {}
+    ParseCache(ParseCache const &) = delete;
+    void operator=(ParseCache const &) = delete;
+
+    std::shared_ptr<const ParsedCommand> lookup(const std::string &raw);
+    void insert(const std::string &raw, std::shared_ptr<const ParsedCommand> parsed);
+    void clear();
+
+    unsigned long hits() const { return hit_count; }
+    unsigned long misses() const { return miss_count; }
+    size_t size() const { return lru.size(); }
+    size_t bytes() const { return used; }
+};
+
+#endif //SMASH_PARSE_CACHE_H_
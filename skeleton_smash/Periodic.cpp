@@ -0,0 +1,230 @@
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <time.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#include <algorithm>
+#include "Periodic.h"
+#include "Commands.h"
+#include "Trace.h"
+
+static uint64_t _nowMs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void PeriodicTask::signalRuns(int signum)
+{
+    for (pid_t pid : running)
+    {
+        kill(pid, signum);
+    }
+}
+
+PeriodicScheduler::PeriodicScheduler(SmallShell &shell) : shell(shell), timer(-1), random(getpid() ^ _nowMs())
+{
+}
+
+PeriodicScheduler::~PeriodicScheduler()
+{
+    if (timer != -1)
+    {
+        shell.getEventLoop().remove(timer);
+        close(timer);
+    }
+}
+
+std::shared_ptr<PeriodicTask> PeriodicScheduler::add(const std::string &line, uint64_t interval, uint64_t jitter,
+                                                     OverlapPolicy overlap)
+{
+    if (timer == -1)
+    {
+        // created with the first task, a shell that never uses every has no timer
+        timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (timer == -1)
+        {
+            perror("smash error: timerfd_create failed");
+            return nullptr;
+        }
+        shell.getEventLoop().add(timer, POLLIN, [this](int, short) { expire(); }, true);
+    }
+    std::shared_ptr<PeriodicTask> task = std::make_shared<PeriodicTask>(line, interval, jitter, overlap);
+    task->tick = _nowMs();
+    schedule(task);
+    arm();
+    return task;
+}
+
+// the next period starts one interval after the last one, so jitter does not make the task drift
+void PeriodicScheduler::schedule(const std::shared_ptr<PeriodicTask> &task)
+{
+    uint64_t now = _nowMs();
+    task->tick += task->interval;
+    if (task->tick <= now)
+    {
+        // smash was held up for whole periods, those ticks are gone
+        task->tick += ((now - task->tick) / task->interval + 1) * task->interval;
+    }
+    uint64_t delay = task->jitter ? std::uniform_int_distribution<uint64_t>(0, task->jitter)(random) : 0;
+    deadlines.push(Deadline{task->tick + delay, task});
+}
+
+void PeriodicScheduler::arm()
+{
+    // the heap top may belong to a cancelled task, waking up for it once is cheaper than searching
+    struct itimerspec when = {};
+    if (not deadlines.empty())
+    {
+        uint64_t due = std::max<uint64_t>(deadlines.top().due, 1);
+        when.it_value.tv_sec = due / 1000;
+        when.it_value.tv_nsec = (due % 1000) * 1000000;
+    }
+    if (timerfd_settime(timer, TFD_TIMER_ABSTIME, &when, nullptr) == -1)
+    {
+        perror("smash error: timerfd_settime failed");
+    }
+}
+
+void PeriodicScheduler::expire()
+{
+    uint64_t expirations;
+    while (read(timer, &expirations, sizeof(expirations)) < 0 && errno == EINTR) {}
+    uint64_t now = _nowMs();
+    while (not deadlines.empty() && deadlines.top().due <= now)
+    {
+        std::shared_ptr<PeriodicTask> task = deadlines.top().task.lock();
+        deadlines.pop();
+        if (task)
+        {
+            schedule(task);
+            fire(task);
+        }
+    }
+    arm();
+}
+
+void PeriodicScheduler::fire(const std::shared_ptr<PeriodicTask> &task)
+{
+    // runs that were reaped, or brought to the foreground and waited for, are over
+    shell.removeFinishedJobs();
+    const JobsList &jobs = shell.getJobs();
+    task->running.erase(std::remove_if(task->running.begin(), task->running.end(),
+                                       [&jobs](pid_t pid) { return jobs.getJobByPid(pid) == nullptr; }),
+                        task->running.end());
+    if (not task->running.empty())
+    {
+        if (task->overlap == OVERLAP_SKIP || (task->overlap == OVERLAP_QUEUE && task->queued >= PERIODIC_QUEUE_LIMIT))
+        {
+            Trace::instant("tick skipped", task->line);
+            task->skipped++;
+            return;
+        }
+        if (task->overlap == OVERLAP_QUEUE)
+        {
+            Trace::instant("tick queued", task->line);
+            task->queued++;
+            return;
+        }
+        // OVERLAP_KILL, the killed run is reaped later like any other job
+        task->signalRuns(SIGKILL);
+        task->running.clear();
+    }
+    launch(task);
+}
+
+void PeriodicScheduler::launch(const std::shared_ptr<PeriodicTask> &task)
+{
+    Trace::instant("tick", task->line);
+    task->runs++;
+    pid_t pid = shell.startBackground(task->line);
+    if (pid > 0)
+    {
+        task->running.push_back(pid);
+        watchRun(task, pid);
+    }
+}
+
+void PeriodicScheduler::watchRun(const std::shared_ptr<PeriodicTask> &task, pid_t pid)
+{
+#ifdef SYS_pidfd_open
+    // only to start a queued run right away, without it the next tick finds the run gone
+    int pidfd = syscall(SYS_pidfd_open, pid, 0);
+    if (pidfd == -1)
+    {
+        return;
+    }
+    std::weak_ptr<PeriodicTask> weak = task;
+    shell.getEventLoop().add(pidfd, POLLIN, [this, weak, pid](int fd, short) {
+        shell.getEventLoop().remove(fd);
+        close(fd);
+        std::shared_ptr<PeriodicTask> task = weak.lock();
+        if (not task)
+        {
+            return;
+        }
+        task->running.erase(std::remove(task->running.begin(), task->running.end(), pid), task->running.end());
+        if (task->queued && task->running.empty())
+        {
+            task->queued--;
+            launch(task);
+        }
+    }, true);
+#endif
+}
+
+bool PeriodicScheduler::parseDuration(const std::string &text, uint64_t &ms)
+{
+    size_t digits = std::min(text.find_first_not_of("0123456789"), text.size());
+    if (digits == 0 || digits > 9)
+    {
+        return false;
+    }
+    uint64_t number = std::stoull(text.substr(0, digits));
+    std::string unit = digits == text.size() ? std::string("s") : text.substr(digits);
+    if (unit == "ms")
+    {
+        ms = number;
+    }
+    else if (unit == "s")
+    {
+        ms = number * 1000;
+    }
+    else if (unit == "m")
+    {
+        ms = number * 60 * 1000;
+    }
+    else if (unit == "h")
+    {
+        ms = number * 60 * 60 * 1000;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+bool PeriodicScheduler::parseOverlap(const std::string &text, OverlapPolicy &overlap)
+{
+    if (text == "skip")
+    {
+        overlap = OVERLAP_SKIP;
+    }
+    else if (text == "queue")
+    {
+        overlap = OVERLAP_QUEUE;
+    }
+    else if (text == "kill")
+    {
+        overlap = OVERLAP_KILL;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
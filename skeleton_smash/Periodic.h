@@ -0,0 +1,87 @@
+#ifndef SMASH_PERIODIC_H_
+#define SMASH_PERIODIC_H_
+
+#include <stdint.h>
+#include <memory>
+#include <queue>
+#include <random>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+#define PERIODIC_QUEUE_LIMIT 16 // ticks a queue task may fall behind by, later ones are skipped
+
+enum OverlapPolicy {
+    OVERLAP_SKIP,  // a tick that comes while the last run is still going is dropped
+    OVERLAP_QUEUE, // it starts as soon as the last run ends
+    OVERLAP_KILL   // the last run gets SIGKILL and the new one starts now
+};
+
+class SmallShell;
+
+// one every command, owned by its entry in the jobs list
+class PeriodicTask {
+    friend class PeriodicScheduler;
+private:
+    std::string line;    // a background command line, started as is on every tick
+    uint64_t interval;   // ms
+    uint64_t jitter;     // ms, each tick is delayed by up to this much
+    OverlapPolicy overlap;
+    uint64_t tick;       // when the current period started, before jitter
+    std::vector<pid_t> running;
+    unsigned int queued;
+    unsigned long long runs;
+    unsigned long long skipped;
+public:
+    PeriodicTask(const std::string &line, uint64_t interval, uint64_t jitter, OverlapPolicy overlap)
+            : line(line), interval(interval), jitter(jitter), overlap(overlap), tick(0), queued(0), runs(0), skipped(0) {}
+
+    unsigned long long getRuns() const { return runs; }
+    unsigned long long getSkipped() const { return skipped; }
+    // sends signum to the runs that are still going, the task itself ends with its job entry
+    void signalRuns(int signum);
+};
+
+/**
+ * Drives every periodic task of the shell (every builtin) from one timerfd in
+ * the event loop, armed for the earliest deadline in a min-heap. Nothing wakes
+ * up between deadlines, however many tasks there are, and the watch is nested
+ * so ticks are not held back by a foreground command.
+ *
+ * A run is started as an ordinary background job, so jobs, fg, kill, capture,
+ * placement and bgprio all apply to it. Its end is seen through a pidfd; the
+ * job itself is reaped like any other background job.
+ */
+class PeriodicScheduler {
+private:
+    struct Deadline {
+        uint64_t due; // CLOCK_MONOTONIC ms
+        std::weak_ptr<PeriodicTask> task; // expired once the task was cancelled
+        bool operator>(const Deadline &other) const { return due > other.due; }
+    };
+    SmallShell &shell;
+    int timer;
+    std::priority_queue<Deadline, std::vector<Deadline>, std::greater<Deadline>> deadlines;
+    std::minstd_rand random;
+
+    void expire();
+    void schedule(const std::shared_ptr<PeriodicTask> &task);
+    void arm();
+    void fire(const std::shared_ptr<PeriodicTask> &task);
+    void launch(const std::shared_ptr<PeriodicTask> &task);
+    void watchRun(const std::shared_ptr<PeriodicTask> &task, pid_t pid);
+public:
+    explicit PeriodicScheduler(SmallShell &shell);
+    PeriodicScheduler(PeriodicScheduler const &) = delete;
+    void operator=(PeriodicScheduler const &) = delete;
+    ~PeriodicScheduler();
+
+    // the first run is one interval from now. returns nullptr if the timer can't be set up
+    std::shared_ptr<PeriodicTask> add(const std::string &line, uint64_t interval, uint64_t jitter, OverlapPolicy overlap);
+
+    // "500ms", "5s", "2m", "1h", a bare number is seconds
+    static bool parseDuration(const std::string &text, uint64_t &ms);
+    static bool parseOverlap(const std::string &text, OverlapPolicy &overlap);
+};
+
+#endif //SMASH_PERIODIC_H_
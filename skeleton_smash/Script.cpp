@@ -0,0 +1,503 @@
+#include <ctype.h>
+#include <glob.h>
+#include <unistd.h>
+#include <sstream>
+#include "Script.h"
+#include "Commands.h"
+#include "FanOut.h"
+
+using namespace std;
+
+//----------------------------------------TOKENIZER-----------------------//
+
+namespace {
+
+enum TokenType { TOKEN_WORD, TOKEN_SEPARATOR, TOKEN_AND, TOKEN_OR, TOKEN_END };
+
+struct Token {
+    TokenType type;
+    string text;
+};
+
+// the text is a prefix of a complete script, more lines are needed
+struct IncompleteScript {};
+
+struct ScriptSyntaxError {
+    string near;
+};
+
+bool endsWithFanOut(const string &word)
+{
+    size_t length = sizeof(FANOUT_OPERATOR) - 1;
+    return word.size() >= length && word.compare(word.size() - length, length, FANOUT_OPERATOR) == 0;
+}
+
+vector<Token> tokenize(const string &text)
+{
+    vector<Token> tokens;
+    string word;
+    auto end_word = [&]() {
+        if (not word.empty())
+        {
+            tokens.push_back(Token{TOKEN_WORD, word});
+            word.clear();
+        }
+    };
+    char quote = 0; // the quote a quoted part of the word started with
+    for (size_t i = 0; i < text.size(); i++)
+    {
+        char c = text[i];
+        if (quote)
+        {
+            // separators and spaces are part of the word, the quotes stay in it for the command to see
+            word += c;
+            if (c == quote) quote = 0;
+        }
+        else if (c == '\'' || c == '"')
+        {
+            word += c;
+            quote = c;
+        }
+        else if (c == ';' || c == '\n')
+        {
+            end_word();
+            tokens.push_back(Token{TOKEN_SEPARATOR, string(1, c)});
+        }
+        else if ((c == '&' || c == '|') && i + 1 < text.size() && text[i + 1] == c)
+        {
+            end_word();
+            tokens.push_back(Token{c == '&' ? TOKEN_AND : TOKEN_OR, string(2, c)});
+            i++;
+        }
+        else if (isspace((unsigned char)c))
+        {
+            end_word();
+        }
+        else if (c == '{' && (word.empty() ? not tokens.empty() && tokens.back().type == TOKEN_WORD &&
+                                             endsWithFanOut(tokens.back().text)
+                                           : endsWithFanOut(word)))
+        {
+            // the consumers of a fan-out are one word, their ; separate them and not statements
+            size_t close = text.find('}', i);
+            if (close == string::npos) throw IncompleteScript();
+            end_word();
+            word = text.substr(i, close - i + 1);
+            end_word();
+            i = close;
+        }
+        else
+        {
+            word += c;
+        }
+    }
+    end_word();
+    tokens.push_back(Token{TOKEN_END, string()});
+    return tokens;
+}
+
+//----------------------------------------PARSER--------------------------//
+
+bool isName(const string &word)
+{
+    if (word.empty() || not (isalpha((unsigned char)word[0]) || word[0] == '_')) return false;
+    for (char c : word)
+    {
+        if (not (isalnum((unsigned char)c) || c == '_')) return false;
+    }
+    return true;
+}
+
+class ScriptParser {
+private:
+    SmallShell &shell;
+    vector<Token> tokens;
+    size_t pos;
+
+    const Token &peek() const { return tokens[pos]; }
+
+    bool atKeyword(const string &keyword) const
+    {
+        return peek().type == TOKEN_WORD && peek().text == keyword;
+    }
+
+    bool atAnyKeyword(const vector<string> &keywords) const
+    {
+        for (const string &keyword : keywords)
+        {
+            if (atKeyword(keyword)) return true;
+        }
+        return false;
+    }
+
+    void fail() const
+    {
+        if (peek().type == TOKEN_END) throw IncompleteScript();
+        throw ScriptSyntaxError{peek().text == "\n" ? string("newline") : peek().text};
+    }
+
+    void expectKeyword(const string &keyword)
+    {
+        if (not atKeyword(keyword)) fail();
+        pos++;
+    }
+
+    void skipSeparators()
+    {
+        while (peek().type == TOKEN_SEPARATOR) pos++;
+    }
+
+    ScriptNodePtr parseList(const vector<string> &terminators)
+    {
+        vector<ScriptNodePtr> statements;
+        skipSeparators();
+        while (peek().type != TOKEN_END && not atAnyKeyword(terminators))
+        {
+            statements.push_back(parseAndOr());
+            if (peek().type == TOKEN_SEPARATOR)
+            {
+                skipSeparators();
+            }
+            else if (peek().type != TOKEN_END)
+            {
+                fail();
+            }
+        }
+        if (not terminators.empty() && (peek().type == TOKEN_END || statements.empty()))
+        {
+            fail();
+        }
+        return ScriptNodePtr(new ListNode(statements));
+    }
+
+    ScriptNodePtr parseAndOr()
+    {
+        vector<ScriptNodePtr> operands;
+        vector<bool> is_and;
+        operands.push_back(parseStatement());
+        while (peek().type == TOKEN_AND || peek().type == TOKEN_OR)
+        {
+            is_and.push_back(peek().type == TOKEN_AND);
+            pos++;
+            while (peek().type == TOKEN_SEPARATOR && peek().text == "\n") pos++;
+            operands.push_back(parseStatement());
+        }
+        if (operands.size() == 1) return operands[0];
+        return ScriptNodePtr(new AndOrNode(operands, is_and));
+    }
+
+    ScriptNodePtr parseStatement()
+    {
+        if (peek().type != TOKEN_WORD ||
+            atAnyKeyword({"do", "done", "then", "elif", "else", "fi", "in"}))
+        {
+            fail();
+        }
+        if (atKeyword("for")) return parseFor();
+        if (atKeyword("while")) return parseWhile();
+        if (atKeyword("if")) return parseIf();
+        return parseSimple();
+    }
+
+    ScriptNodePtr parseSimple()
+    {
+        string text;
+        while (peek().type == TOKEN_WORD)
+        {
+            text += (text.empty() ? "" : " ") + peek().text;
+            pos++;
+        }
+        return ScriptNodePtr(new SimpleNode(shell, text));
+    }
+
+    ScriptNodePtr parseFor()
+    {
+        expectKeyword("for");
+        if (peek().type != TOKEN_WORD || not isName(peek().text)) fail();
+        string variable = peek().text;
+        pos++;
+        expectKeyword("in");
+        vector<string> words;
+        while (peek().type == TOKEN_WORD)
+        {
+            words.push_back(peek().text);
+            pos++;
+        }
+        skipSeparators();
+        expectKeyword("do");
+        ScriptNodePtr body = parseList({"done"});
+        expectKeyword("done");
+        return ScriptNodePtr(new ForNode(variable, words, body));
+    }
+
+    ScriptNodePtr parseWhile()
+    {
+        expectKeyword("while");
+        ScriptNodePtr condition = parseList({"do"});
+        expectKeyword("do");
+        ScriptNodePtr body = parseList({"done"});
+        expectKeyword("done");
+        return ScriptNodePtr(new WhileNode(condition, body));
+    }
+
+    ScriptNodePtr parseIf()
+    {
+        vector<pair<ScriptNodePtr, ScriptNodePtr>> branches;
+        ScriptNodePtr else_body;
+        expectKeyword("if");
+        while (true)
+        {
+            ScriptNodePtr condition = parseList({"then"});
+            expectKeyword("then");
+            ScriptNodePtr body = parseList({"elif", "else", "fi"});
+            branches.push_back(make_pair(condition, body));
+            if (not atKeyword("elif")) break;
+            pos++;
+        }
+        if (atKeyword("else"))
+        {
+            pos++;
+            else_body = parseList({"fi"});
+        }
+        expectKeyword("fi");
+        return ScriptNodePtr(new IfNode(branches, else_body));
+    }
+
+public:
+    ScriptParser(SmallShell &shell, const vector<Token> &tokens) : shell(shell), tokens(tokens), pos(0) {}
+
+    ScriptNodePtr parseProgram()
+    {
+        return parseList({});
+    }
+};
+
+} // namespace
+
+//----------------------------------------EXPANSION-----------------------//
+
+bool isAssignment(const string &word)
+{
+    size_t eq = word.find('=');
+    return eq != string::npos && isName(word.substr(0, eq));
+}
+
+string expandVariables(SmallShell &shell, const string &text)
+{
+    string result;
+    for (size_t i = 0; i < text.size(); i++)
+    {
+        if (text[i] != '$' || i + 1 == text.size())
+        {
+            result += text[i];
+            continue;
+        }
+        char next = text[i + 1];
+        if (next == '?')
+        {
+            result += to_string(shell.getStatus());
+            i++;
+        }
+        else if (next == '$')
+        {
+            result += to_string(getpid());
+            i++;
+        }
+        else if (next == '{')
+        {
+            size_t close = text.find('}', i + 2);
+            if (close == string::npos)
+            {
+                result += text[i];
+                continue;
+            }
+            result += shell.getVariable(text.substr(i + 2, close - i - 2));
+            i = close;
+        }
+        else if (isalpha((unsigned char)next) || next == '_')
+        {
+            size_t end = i + 1;
+            while (end < text.size() && (isalnum((unsigned char)text[end]) || text[end] == '_')) end++;
+            result += shell.getVariable(text.substr(i + 1, end - i - 1));
+            i = end - 1;
+        }
+        else
+        {
+            result += text[i];
+        }
+    }
+    return result;
+}
+
+// the words of a for list are globbed like sh does, a pattern matching nothing stays as is
+static vector<string> expandPattern(const string &field)
+{
+    vector<string> values;
+    glob_t matches;
+    if (field.find_first_of("*?[") != string::npos && glob(field.c_str(), 0, nullptr, &matches) == 0)
+    {
+        for (size_t i = 0; i < matches.gl_pathc; i++)
+        {
+            values.push_back(matches.gl_pathv[i]);
+        }
+        globfree(&matches);
+    }
+    if (values.empty())
+    {
+        values.push_back(field);
+    }
+    return values;
+}
+
+//----------------------------------------NODES---------------------------//
+
+SimpleNode::SimpleNode(SmallShell &shell, const string &text) : text(text)
+{
+    // lines without expansion are parsed once, here, instead of on every run. a fan-out is split by FanOut
+    if (text.find('$') == string::npos && not FanOut::matches(text))
+    {
+        parsed = shell.parseCommand(text);
+    }
+}
+
+int SimpleNode::run(SmallShell &shell)
+{
+    std::shared_ptr<const ParsedCommand> command = parsed;
+    string line = text;
+    if (not command)
+    {
+        line = expandVariables(shell, text);
+        if (FanOut::matches(line))
+        {
+            return shell.executeFanOut(line);
+        }
+        command = shell.parseCommand(line);
+    }
+    if (command->args.empty() && not command->assignments.empty())
+    {
+        // NAME=value without a command sets shell variables
+        for (const string &assignment : command->assignments)
+        {
+            size_t eq = assignment.find('=');
+            shell.setVariable(assignment.substr(0, eq), assignment.substr(eq + 1));
+        }
+        shell.setStatus(0);
+        return 0;
+    }
+    return shell.executeParsed(command, line);
+}
+
+int ListNode::run(SmallShell &shell)
+{
+    int status = 0;
+    for (auto &statement : statements)
+    {
+        if (not shell.isRunning()) break;
+        status = statement->run(shell);
+    }
+    return status;
+}
+
+int AndOrNode::run(SmallShell &shell)
+{
+    int status = operands[0]->run(shell);
+    for (size_t i = 1; i < operands.size() && shell.isRunning(); i++)
+    {
+        if (is_and[i - 1] == (status == 0))
+        {
+            status = operands[i]->run(shell);
+        }
+    }
+    return status;
+}
+
+int ForNode::run(SmallShell &shell)
+{
+    int status = 0;
+    for (const string &word : words)
+    {
+        istringstream fields(expandVariables(shell, word));
+        for (string field; fields >> field && shell.isRunning(); )
+        {
+            for (const string &value : expandPattern(field))
+            {
+                if (not shell.isRunning()) break;
+                shell.setVariable(variable, value);
+                status = body->run(shell);
+            }
+        }
+    }
+    shell.setStatus(status);
+    return status;
+}
+
+int WhileNode::run(SmallShell &shell)
+{
+    int status = 0;
+    while (shell.isRunning() && condition->run(shell) == 0)
+    {
+        status = body->run(shell);
+    }
+    shell.setStatus(status);
+    return status;
+}
+
+int IfNode::run(SmallShell &shell)
+{
+    for (auto &branch : branches)
+    {
+        if (branch.first->run(shell) == 0)
+        {
+            return branch.second->run(shell);
+        }
+    }
+    int status = else_body ? else_body->run(shell) : 0;
+    shell.setStatus(status);
+    return status;
+}
+
+//----------------------------------------INTERPRETER---------------------//
+
+bool ScriptInterpreter::wants(const string &cmd_line, std::shared_ptr<const ParsedCommand> &parsed) const
+{
+    if (inBlock()) return true;
+    if (cmd_line.find_first_of(";$") != string::npos ||
+        cmd_line.find("&&") != string::npos || cmd_line.find("||") != string::npos)
+    {
+        return true;
+    }
+    if (FanOut::matches(cmd_line))
+    {
+        return false; // not one command, there is nothing to parse
+    }
+    // the first word as the parse cache has it, a line seen before costs a lookup and no copies
+    parsed = shell.parseCommand(cmd_line);
+    if (not parsed->assignments.empty())
+    {
+        return true;
+    }
+    const string &first = parsed->args.empty() ? cmd_line : parsed->args[0];
+    return first == "for" || first == "while" || first == "if";
+}
+
+void ScriptInterpreter::feed(const string &cmd_line)
+{
+    string text = inBlock() ? pending + "\n" + cmd_line : cmd_line;
+    ScriptNodePtr program;
+    try
+    {
+        program = ScriptParser(shell, tokenize(text)).parseProgram();
+    }
+    catch (const IncompleteScript &)
+    {
+        pending = text;
+        return;
+    }
+    catch (const ScriptSyntaxError &e)
+    {
+        pending.clear();
+        shell.smash_error("syntax error near unexpected token `" + e.near + "'");
+        return;
+    }
+    pending.clear();
+    program->run(shell);
+}
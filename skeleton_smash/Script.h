@@ -0,0 +1,111 @@
+#ifndef SMASH_SCRIPT_H_
+#define SMASH_SCRIPT_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "ParseCache.h"
+
+class SmallShell;
+
+/**
+ * A statement of the small script language. Leaves are simple commands that
+ * were parsed into a ParsedCommand when the script was compiled (unless they
+ * need $VAR expansion, then they are parsed through the cache when run).
+ */
+class ScriptNode {
+public:
+    virtual ~ScriptNode() = default;
+    // runs the statement and returns its exit status
+    virtual int run(SmallShell &shell) = 0;
+};
+
+typedef std::shared_ptr<ScriptNode> ScriptNodePtr;
+
+class SimpleNode : public ScriptNode {
+private:
+    std::string text;
+    std::shared_ptr<const ParsedCommand> parsed; // null when text needs expansion
+public:
+    SimpleNode(SmallShell &shell, const std::string &text);
+    int run(SmallShell &shell) override;
+};
+
+class ListNode : public ScriptNode {
+private:
+    std::vector<ScriptNodePtr> statements;
+public:
+    explicit ListNode(std::vector<ScriptNodePtr> statements) : statements(statements) {}
+    int run(SmallShell &shell) override;
+};
+
+// a && b || c, evaluated left to right like sh does
+class AndOrNode : public ScriptNode {
+private:
+    std::vector<ScriptNodePtr> operands;
+    std::vector<bool> is_and; // operator in front of operands[i + 1]
+public:
+    AndOrNode(std::vector<ScriptNodePtr> operands, std::vector<bool> is_and) : operands(operands), is_and(is_and) {}
+    int run(SmallShell &shell) override;
+};
+
+class ForNode : public ScriptNode {
+private:
+    std::string variable;
+    std::vector<std::string> words;
+    ScriptNodePtr body;
+public:
+    ForNode(const std::string &variable, std::vector<std::string> words, ScriptNodePtr body) :
+        variable(variable), words(words), body(body) {}
+    int run(SmallShell &shell) override;
+};
+
+class WhileNode : public ScriptNode {
+private:
+    ScriptNodePtr condition;
+    ScriptNodePtr body;
+public:
+    WhileNode(ScriptNodePtr condition, ScriptNodePtr body) : condition(condition), body(body) {}
+    int run(SmallShell &shell) override;
+};
+
+class IfNode : public ScriptNode {
+private:
+    std::vector<std::pair<ScriptNodePtr, ScriptNodePtr>> branches; // (condition, body), if + elifs
+    ScriptNodePtr else_body;
+public:
+    IfNode(std::vector<std::pair<ScriptNodePtr, ScriptNodePtr>> branches, ScriptNodePtr else_body) :
+        branches(branches), else_body(else_body) {}
+    int run(SmallShell &shell) override;
+};
+
+/**
+ * Collects lines until they form complete statements (a for/while/if may span
+ * several lines), compiles them and runs them on the shell. Each source of
+ * lines has its own, so a line from one is never taken into a block another
+ * one is in the middle of.
+ */
+class ScriptInterpreter {
+private:
+    SmallShell &shell;
+    std::string pending;
+public:
+    explicit ScriptInterpreter(SmallShell &shell) : shell(shell) {}
+    ScriptInterpreter(ScriptInterpreter const &) = delete;
+    void operator=(ScriptInterpreter const &) = delete;
+
+    // true if the line has to go through the interpreter rather than straight to executeCommand.
+    // otherwise parsed is the line's parse, if it had to be looked up to decide
+    bool wants(const std::string &cmd_line, std::shared_ptr<const ParsedCommand> &parsed) const;
+    void feed(const std::string &cmd_line);
+    bool inBlock() const { return not pending.empty(); }
+    // drops a block that was never completed
+    void reset() { pending.clear(); }
+};
+
+// $NAME, ${NAME}, $? and $$ substitution
+std::string expandVariables(SmallShell &shell, const std::string &text);
+// NAME=VALUE as a single word
+bool isAssignment(const std::string &word);
+
+#endif //SMASH_SCRIPT_H_
@@ -0,0 +1,192 @@
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <algorithm>
+#include <atomic>
+#include <sstream>
+#include "Trace.h"
+
+struct TraceEvent {
+    std::atomic<int> ready; // set last, a claimed slot may still be half written
+    char phase;             // Chrome's ph: i, X, b or e
+    pid_t pid;
+    pid_t tid;
+    long id;
+    uint64_t ts;
+    uint64_t dur;
+    char name[TRACE_NAME_SIZE];
+    char detail[TRACE_DETAIL_SIZE];
+};
+
+struct TraceBuffer {
+    std::atomic<uint64_t> next;
+    std::atomic<uint64_t> dropped;
+    TraceEvent events[TRACE_CAPACITY];
+};
+
+static TraceBuffer *buffer = nullptr;
+static int trace_fd = -1; // opened with the buffer, so a bad path fails at startup and not at exit
+static pid_t owner = 0; // forked children share the buffer but must not write the file
+
+static void _record(char phase, const char *name, long id, uint64_t ts, uint64_t dur, const std::string &detail)
+{
+    uint64_t slot = buffer->next.fetch_add(1, std::memory_order_relaxed);
+    if (slot >= TRACE_CAPACITY)
+    {
+        buffer->dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    TraceEvent &event = buffer->events[slot];
+    event.phase = phase;
+    event.pid = getpid();
+    event.tid = syscall(SYS_gettid);
+    event.id = id;
+    event.ts = ts;
+    event.dur = dur;
+    strncpy(event.name, name, TRACE_NAME_SIZE - 1);
+    strncpy(event.detail, detail.c_str(), TRACE_DETAIL_SIZE - 1);
+    event.ready.store(1, std::memory_order_release);
+}
+
+static void _writeJsonString(std::ostream &out, const char *text)
+{
+    out << '"';
+    for (const char *c = text; *c; c++)
+    {
+        if (*c == '"' || *c == '\\')
+        {
+            out << '\\' << *c;
+        }
+        else if ((unsigned char)*c < 0x20)
+        {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", *c);
+            out << escaped;
+        }
+        else
+        {
+            out << *c;
+        }
+    }
+    out << '"';
+}
+
+bool Trace::enabled()
+{
+    return buffer != nullptr;
+}
+
+bool Trace::open(const std::string &path)
+{
+    trace_fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (trace_fd == -1)
+    {
+        perror("smash error: open failed");
+        return false;
+    }
+    void *memory = mmap(nullptr, sizeof(TraceBuffer), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED)
+    {
+        perror("smash error: mmap failed");
+        close(trace_fd);
+        trace_fd = -1;
+        return false;
+    }
+    // fresh anonymous memory is zero, which is what every counter and flag starts as
+    buffer = static_cast<TraceBuffer*>(memory);
+    owner = getpid();
+    return true;
+}
+
+void Trace::flush()
+{
+    if (not buffer || getpid() != owner)
+    {
+        return;
+    }
+    std::ostringstream out;
+    out << "{\"traceEvents\":[\n";
+    out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << owner << ",\"args\":{\"name\":\"smash\"}}";
+    uint64_t count = std::min<uint64_t>(buffer->next.load(), TRACE_CAPACITY);
+    for (uint64_t i = 0; i < count; i++)
+    {
+        const TraceEvent &event = buffer->events[i];
+        if (not event.ready.load(std::memory_order_acquire))
+        {
+            continue;
+        }
+        out << ",\n{\"name\":";
+        _writeJsonString(out, event.name);
+        out << ",\"ph\":\"" << event.phase << "\",\"ts\":" << event.ts << ",\"pid\":" << event.pid
+            << ",\"tid\":" << event.tid;
+        if (event.phase == 'X')
+        {
+            out << ",\"dur\":" << event.dur;
+        }
+        else if (event.phase == 'i')
+        {
+            out << ",\"s\":\"t\"";
+        }
+        else
+        {
+            out << ",\"cat\":\"job\",\"id\":" << event.id;
+        }
+        if (event.detail[0])
+        {
+            out << ",\"args\":{\"detail\":";
+            _writeJsonString(out, event.detail);
+            out << "}";
+        }
+        out << "}";
+    }
+    out << "\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"dropped\":" << buffer->dropped.load() << "}}\n";
+    const std::string text = out.str();
+    for (size_t done = 0; done < text.size(); )
+    {
+        ssize_t n = write(trace_fd, text.data() + done, text.size() - done);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n < 0)
+        {
+            perror("smash error: write failed");
+            break;
+        }
+        done += n;
+    }
+    close(trace_fd);
+    trace_fd = -1;
+}
+
+uint64_t Trace::now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void Trace::instant(const char *name, const std::string &detail)
+{
+    if (buffer) _record('i', name, 0, now(), 0, detail);
+}
+
+void Trace::complete(const char *name, uint64_t start, const std::string &detail)
+{
+    if (buffer) _record('X', name, 0, start, now() - start, detail);
+}
+
+void Trace::asyncBegin(const char *name, long id, const std::string &detail)
+{
+    if (buffer) _record('b', name, id, now(), 0, detail);
+}
+
+void Trace::asyncEnd(const char *name, long id, const std::string &detail)
+{
+    if (buffer) _record('e', name, id, now(), 0, detail);
+}
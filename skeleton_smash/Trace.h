@@ -0,0 +1,55 @@
+#ifndef SMASH_TRACE_H_
+#define SMASH_TRACE_H_
+
+#include <stdint.h>
+#include <string>
+
+#define TRACE_CAPACITY (1 << 16) // events, further ones are counted and dropped
+#define TRACE_NAME_SIZE 24
+#define TRACE_DETAIL_SIZE 80
+
+/**
+ * Timeline of shell and job events (smash --trace=FILE), written out in the
+ * Chrome trace event format so a batch run can be loaded in a trace viewer.
+ *
+ * Events go into one fixed array in a MAP_SHARED anonymous mapping, slots are
+ * claimed with an atomic counter. Recording therefore never locks, works from
+ * any thread, and from a forked child between fork and exec, whose events
+ * land in the same array. open() creates the file, so a bad path fails at
+ * startup, and flush() writes it, once, from the shell. Every call is a
+ * cheap no-op unless open() succeeded.
+ */
+class Trace {
+public:
+    // true if tracing is on, the calls below may be skipped when it is not
+    static bool enabled();
+    static bool open(const std::string &path);
+    static void flush();
+
+    // CLOCK_MONOTONIC in microseconds, the trace's time base
+    static uint64_t now();
+
+    // a point in time, e.g. "fork"
+    static void instant(const char *name, const std::string &detail = std::string());
+    // a span from start (a now() value) until now, e.g. "parse"
+    static void complete(const char *name, uint64_t start, const std::string &detail = std::string());
+    // a span that starts and ends in different places, matched by id, e.g. a job from fork to reap
+    static void asyncBegin(const char *name, long id, const std::string &detail = std::string());
+    static void asyncEnd(const char *name, long id, const std::string &detail = std::string());
+};
+
+// records a complete event for the enclosing scope
+class TraceSpan {
+private:
+    const char *name;
+    std::string detail;
+    uint64_t start;
+public:
+    TraceSpan(const char *name, const std::string &detail = std::string())
+            : name(name), detail(Trace::enabled() ? detail : std::string()), start(Trace::enabled() ? Trace::now() : 0) {}
+    TraceSpan(TraceSpan const &) = delete;
+    void operator=(TraceSpan const &) = delete;
+    ~TraceSpan() { if (start) Trace::complete(name, start, detail); }
+};
+
+#endif //SMASH_TRACE_H_
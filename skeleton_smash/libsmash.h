@@ -0,0 +1,28 @@
+#ifndef SMASH_LIBSMASH_H_
+#define SMASH_LIBSMASH_H_
+
+/**
+ * Public header of libsmash.a.
+ *
+ * A Shell owns its prompt, previous directory, jobs list, event loop and
+ * output streams, so any number of them can live in one process:
+ *
+ *     std::thread worker([] {
+ *         Shell::isolateThread();      // private cwd and fd table
+ *         Shell shell;
+ *         shell.executeCommand("cd /tmp");
+ *         shell.executeCommand("ls > listing.txt");
+ *     });
+ *
+ * The working directory and the descriptor table are per process on Linux
+ * unless the thread is isolated first, and per thread after that, never per
+ * Shell. Run one Shell per isolated thread: two shells on one thread share
+ * the working directory, and when one of them changes it the other's pwd and
+ * cd - are left pointing at a directory it is no longer in. `quit` only stops
+ * the instance (see Shell::isRunning), it never exits the host process.
+ */
+#include "Commands.h"
+
+typedef SmallShell Shell;
+
+#endif //SMASH_LIBSMASH_H_
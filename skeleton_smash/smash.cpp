@@ -1,22 +1,122 @@
 #include <iostream>
 #include <unistd.h>
+#include <errno.h>
+#include <string.h>
 #include <sys/wait.h>
 #include <signal.h>
 #include "Commands.h"
+#include "ControlSocket.h"
 #include "signals.h"
+#include "Trace.h"
+
+#define LISTEN_FLAG std::string("--listen")
+#define TRACE_FLAG std::string("--trace")
+#define STATE_FLAG std::string("--state")
+
+static std::string stdin_buffer;
+static bool stdin_eof = false;
+
+static void readStdin(int fd)
+{
+    char buf[4096];
+    ssize_t n = read(fd, buf, sizeof(buf));
+    if (n > 0)
+    {
+        stdin_buffer.append(buf, n);
+    }
+    else if (n == 0 || errno != EINTR)
+    {
+        stdin_eof = true;
+    }
+}
+
+// pumps the event loop until a full line arrived on stdin. returns false on EOF.
+static bool readCommandLine(SmallShell &smash, std::string &cmd_line)
+{
+    while (smash.isRunning())
+    {
+        size_t newline = stdin_buffer.find('\n');
+        if (newline != std::string::npos)
+        {
+            cmd_line.assign(stdin_buffer, 0, newline);
+            stdin_buffer.erase(0, newline + 1);
+            return true;
+        }
+        if (stdin_eof)
+        {
+            cmd_line = stdin_buffer;
+            stdin_buffer.clear();
+            return not cmd_line.empty();
+        }
+        if (smash.getEventLoop().runOnce(-1) < 0) return false;
+    }
+    return false;
+}
 
 int main(int argc, char* argv[]) {
     if(signal(SIGINT , ctrlCHandler)==SIG_ERR) {
         perror("smash error: failed to set ctrl-C handler");
     }
 
+    std::string listen_path;
+    std::string trace_path;
+    std::string state_path;
+    for (int i = 1; i < argc; i++) {
+        std::string arg(argv[i]);
+        if (arg == LISTEN_FLAG && i + 1 < argc) {
+            listen_path = argv[++i];
+        }
+        else if (arg.compare(0, LISTEN_FLAG.size() + 1, LISTEN_FLAG + "=") == 0) {
+            listen_path = arg.substr(LISTEN_FLAG.size() + 1);
+        }
+        else if (arg == TRACE_FLAG && i + 1 < argc) {
+            trace_path = argv[++i];
+        }
+        else if (arg.compare(0, TRACE_FLAG.size() + 1, TRACE_FLAG + "=") == 0) {
+            trace_path = arg.substr(TRACE_FLAG.size() + 1);
+        }
+        else if (arg == STATE_FLAG && i + 1 < argc) {
+            state_path = argv[++i];
+        }
+        else if (arg.compare(0, STATE_FLAG.size() + 1, STATE_FLAG + "=") == 0) {
+            state_path = arg.substr(STATE_FLAG.size() + 1);
+        }
+        else {
+            std::cerr << "usage: smash [--listen SOCKET_PATH] [--trace TRACE_FILE] [--state STATE_FILE]" << std::endl;
+            return 1;
+        }
+    }
+    if (not trace_path.empty() && not Trace::open(trace_path)) {
+        return 1;
+    }
+
     //TODO: setup sig alarm handler
     SmallShell& smash = SmallShell::getInstance();
-    while(true) {
-        std::cout << smash.getCurrentPrompt() << PROMPT_SUFFIX;
-        std::string cmd_line;
-        std::getline(std::cin, cmd_line);
-        smash.executeCommand(cmd_line.c_str());
+    if (not state_path.empty() && not smash.restoreJobs(state_path)) {
+        return 1;
+    }
+    std::unique_ptr<ControlSocket> control;
+    if (not listen_path.empty()) {
+        control.reset(new ControlSocket(smash, listen_path));
+        if (not control->listen()) {
+            return 1;
+        }
+    }
+
+    smash.getEventLoop().add(STDIN_FILENO, POLLIN, [](int fd, short) { readStdin(fd); });
+    std::string cmd_line; // reused, its buffer grows to the longest line once
+    while(smash.isRunning()) {
+        smash.out() << smash.getCurrentPrompt() << PROMPT_SUFFIX;
+        if (not readCommandLine(smash, cmd_line)) break;
+        Trace::instant("line read", cmd_line);
+        smash.executeCommand(cmd_line);
+    }
+    if (control && stdin_eof) {
+        // a listening smash is a daemon too: without stdin (</dev/null, a closed terminal)
+        // it keeps serving its clients until one of them runs quit
+        smash.getEventLoop().remove(STDIN_FILENO);
+        while (smash.isRunning() && smash.getEventLoop().runOnce(-1) >= 0) {}
     }
+    Trace::flush();
     return 0;
-}
\ No newline at end of file
+}
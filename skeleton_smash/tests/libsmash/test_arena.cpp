@@ -0,0 +1,88 @@
+// checks that the per-command scratch of libsmash stays in the shell's arena:
+// resolving a command against PATH costs no heap allocations however long
+// PATH is, the arena stops growing once it has seen the commands, and a
+// nested command's mark/rewind gives back only what it used.
+
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include "../../libsmash.h"
+
+static long allocations = 0;
+
+void *operator new(size_t size)
+{
+    allocations++;
+    void *p = malloc(size ? size : 1);
+    if (p == NULL) throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+static int failures = 0;
+
+static void check(bool ok, const std::string &what)
+{
+    printf("%s: %s\n", ok ? "ok" : "FAILED", what.c_str());
+    if (not ok) failures++;
+}
+
+// heap allocations made by one run of cmd_line, once the parse cache and the
+// job bookkeeping have grown to it
+static long allocationsOf(Shell &shell, const std::string &cmd_line)
+{
+    shell.executeCommand(cmd_line);
+    shell.executeCommand(cmd_line);
+    long before = allocations;
+    shell.executeCommand(cmd_line);
+    return allocations - before;
+}
+
+int main()
+{
+    Shell shell;
+
+    std::string long_path = "/bin";
+    for (int i = 0; i < 40; i++)
+    {
+        long_path = "/nonexistent/dir" + std::to_string(i) + ":" + long_path;
+    }
+    shell.executeCommand("export PATH=/bin");
+    long short_walk = allocationsOf(shell, "smash_no_such_command");
+    shell.executeCommand("export PATH=" + long_path);
+    long long_walk = allocationsOf(shell, "smash_no_such_command");
+    check(short_walk == long_walk, "the PATH walk allocates nothing per entry (" +
+          std::to_string(short_walk) + " vs " + std::to_string(long_walk) + ")");
+
+    size_t capacity = shell.getArena().capacity();
+    for (int i = 0; i < 100; i++)
+    {
+        shell.executeCommand("true");
+        shell.executeCommand("echo arena > /dev/null");
+    }
+    check(shell.getArena().capacity() == capacity, "the arena keeps its blocks across commands");
+
+    Arena arena(256);
+    arena.allocate(100);
+    Arena::Mark mark = arena.mark();
+    void *first = arena.allocate(64);
+    for (int i = 0; i < 10; i++)
+    {
+        arena.allocate(200); // spills into new blocks
+    }
+    arena.rewind(mark);
+    check(arena.allocate(64) == first, "rewind frees what was allocated since the mark");
+    size_t blocks = arena.capacity();
+    for (int i = 0; i < 10; i++)
+    {
+        arena.allocate(200);
+    }
+    check(arena.capacity() == blocks, "blocks freed by rewind are reused");
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,81 @@
+// runs two shells at once, each on its own isolated thread, and checks that
+// neither sees the other's working directory, previous directory or jobs, and
+// that the host process keeps its own working directory.
+
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <atomic>
+#include <climits>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "../../libsmash.h"
+
+static int failures = 0;
+static std::mutex report_lock;
+
+static void check(bool ok, const std::string &what)
+{
+    std::lock_guard<std::mutex> guard(report_lock);
+    printf("%s: %s\n", ok ? "ok" : "FAILED", what.c_str());
+    if (not ok) failures++;
+}
+
+static std::string processDir()
+{
+    char buf[PATH_MAX];
+    return getcwd(buf, sizeof(buf)) ? buf : "";
+}
+
+// both shells are set up before either looks at its state
+static std::atomic<int> ready(0);
+
+static void waitForBoth()
+{
+    ready++;
+    while (ready < 2)
+    {
+        std::this_thread::yield();
+    }
+}
+
+static void runShell(const std::string &name, const std::string &dir, int jobs)
+{
+    if (not Shell::isolateThread())
+    {
+        check(false, name + ": isolateThread");
+        return;
+    }
+    Shell shell;
+    shell.executeCommand("cd " + dir);
+    shell.executeCommand("cd /");
+    for (int i = 0; i < jobs; i++)
+    {
+        shell.executeCommand("sleep 5 &");
+    }
+    waitForBoth();
+
+    check(shell.getCurrentDir() == "/" && processDir() == "/", name + ": cwd is its own");
+    shell.executeCommand("cd -");
+    check(shell.getCurrentDir() == dir && processDir() == dir, name + ": cd - goes back to its own directory");
+    check(shell.get_num_jobs() == jobs, name + ": sees only its own " + std::to_string(jobs) + " jobs");
+    for (int i = 1; i <= jobs; i++)
+    {
+        pid_t pid = shell.getPidById(i);
+        kill(pid, SIGKILL);
+        waitpid(pid, nullptr, 0);
+    }
+}
+
+int main()
+{
+    std::string host_dir = processDir();
+    std::thread first(runShell, "first", "/tmp", 2);
+    std::thread second(runShell, "second", "/usr", 0);
+    first.join();
+    second.join();
+    check(processDir() == host_dir, "the host process stayed in " + host_dir);
+    return failures ? 1 : 0;
+}
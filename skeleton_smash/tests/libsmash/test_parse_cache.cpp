@@ -0,0 +1,53 @@
+// checks the parse cache behind SmallShell::parseCommand: repeated lines are
+// hits, a PATH change drops what was resolved against the old one, and once
+// the budget is spent the least recently used line goes first.
+
+#include <cstdio>
+#include <string>
+#include "../../libsmash.h"
+
+static int failures = 0;
+
+static void check(bool ok, const std::string &what)
+{
+    printf("%s: %s\n", ok ? "ok" : "FAILED", what.c_str());
+    if (not ok) failures++;
+}
+
+int main()
+{
+    Shell shell;
+    const ParseCache &cache = shell.getParseCache();
+
+    unsigned long hits = cache.hits(), misses = cache.misses();
+    for (int i = 0; i < 3; i++)
+    {
+        shell.executeCommand("true");
+    }
+    check(cache.misses() - misses == 1 && cache.hits() - hits == 2, "a repeated line is parsed once");
+
+    shell.executeCommand("export PATH=/usr/bin:/bin");
+    check(cache.size() == 0, "changing PATH empties the cache");
+    misses = cache.misses();
+    shell.executeCommand("true");
+    check(cache.misses() - misses == 1, "the line is parsed again after PATH changed");
+
+    // lines of the same length cost the same, the budget fits three and a half
+    ParseCache sizing;
+    sizing.insert("echo a", shell.parseCommand("echo a"));
+    size_t cost = sizing.bytes();
+    ParseCache lru(cost * 3 + cost / 2);
+    const char *lines[] = {"echo a", "echo b", "echo c", "echo d"};
+    for (int i = 0; i < 3; i++)
+    {
+        lru.insert(lines[i], shell.parseCommand(lines[i]));
+    }
+    check(lru.size() == 3, "three lines fit the budget");
+    lru.lookup("echo a");
+    lru.insert(lines[3], shell.parseCommand(lines[3]));
+    check(lru.size() == 3 && lru.bytes() <= cost * 3 + cost / 2, "a fourth line evicts one");
+    check(lru.lookup("echo b") == nullptr, "the least recently used line was evicted");
+    check(lru.lookup("echo a") && lru.lookup("echo c") && lru.lookup("echo d"), "the others are kept");
+
+    return failures ? 1 : 0;
+}
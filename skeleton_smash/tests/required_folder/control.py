@@ -0,0 +1,82 @@
+#! /usr/bin/python3
+
+# starts the smash that started this script with --listen and no stdin, sends
+# it the requests in $1, one per line, and prints the responses. the pids in
+# jobs and kill responses are replaced with PID. a "#oversized" line sends a
+# frame too long to be served on a connection of its own.
+
+import os
+import socket
+import struct
+import subprocess
+import sys
+import time
+
+SOCKET_PATH = "control.sock"
+MAX_REQUEST = 1 << 20
+
+
+def connect():
+    conn = socket.socket(socket.AF_UNIX)
+    conn.connect(SOCKET_PATH)
+    return conn
+
+
+def read_frame(stream):
+    header = stream.read(4)
+    if len(header) < 4:
+        return None
+    return stream.read(struct.unpack(">I", header)[0]).decode()
+
+
+def hide_pids(request, response):
+    status, _, body = response.partition("\n")
+    if status != "ok":
+        return response
+    lines = body.splitlines()
+    if request == "jobs":
+        lines = ["\t".join(f if i != 1 else "PID" for i, f in enumerate(line.split("\t"))) for line in lines]
+    elif request.startswith("kill"):
+        lines = ["PID\t" + line.split("\t", 1)[1] for line in lines]
+    return "\n".join([status] + lines)
+
+
+def oversized():
+    conn = connect()
+    conn.sendall(struct.pack(">I", MAX_REQUEST + 1))
+    stream = conn.makefile("rb")
+    print(read_frame(stream))
+    print("closed" if stream.read(1) == b"" else "still open")
+    conn.close()
+
+
+def main():
+    smash = os.readlink("/proc/%d/exe" % os.getppid())
+    with open(sys.argv[1]) as f:
+        requests = f.read().splitlines()
+    shell = subprocess.Popen([smash, "--listen", SOCKET_PATH], stdin=subprocess.DEVNULL,
+                             stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    for _ in range(100):
+        if os.path.exists(SOCKET_PATH):
+            break
+        time.sleep(0.05)
+    conn = connect()
+    stream = conn.makefile("rb")
+    for request in requests:
+        if request == "#oversized":
+            oversized()
+            continue
+        print("> " + request)
+        conn.sendall(struct.pack(">I", len(request)) + request.encode())
+        response = read_frame(stream)
+        if response is None:
+            print("closed")
+            break
+        print(hide_pids(request, response))
+    conn.close()
+    print("smash exited with %d" % shell.wait())
+    print("socket removed" if not os.path.exists(SOCKET_PATH) else "socket left behind")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,6 @@
+#! /bin/sh
+
+# runs the smash that started this script with the given options, on the commands in $1
+input=$1
+shift
+exec "$(readlink /proc/$PPID/exe)" "$@" < "$input"